@@ -0,0 +1,53 @@
+#!/bin/bash
+# Measure the throughput of the recognition event sink when writing to
+# a file, a named pipe, and a Unix socket, at several event rates.
+#
+# EXAMPLES
+#
+# Run each output for 5 seconds at the default rates:
+# ./scripts/bench-events.sh
+#
+# Run each output for 10 seconds at 1k and 100k events/s:
+# ./scripts/bench-events.sh 10 1000 100000
+
+# parse arguments
+SECONDS_PER_RUN=${1:-5}
+shift
+RATES=${*:-1000 5000 20000 50000}
+
+TMPDIR=$(mktemp -d)
+trap "rm -rf $TMPDIR" EXIT
+
+# build executable
+make bench-events > /dev/null || exit 1
+
+for RATE in $RATES; do
+	# file
+	echo "file, $RATE events/s"
+	./bench-events $TMPDIR/events.jsonl $RATE $SECONDS_PER_RUN
+	rm -f $TMPDIR/events.jsonl
+
+	# named pipe, drained by a reader
+	echo "fifo, $RATE events/s"
+	mkfifo $TMPDIR/events.fifo
+	cat $TMPDIR/events.fifo > /dev/null &
+	./bench-events $TMPDIR/events.fifo $RATE $SECONDS_PER_RUN
+	wait
+	rm -f $TMPDIR/events.fifo
+
+	# unix socket, drained by a listener
+	echo "socket, $RATE events/s"
+	python3 -c "
+import socket, sys
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+s.bind(sys.argv[1])
+s.listen(1)
+c, _ = s.accept()
+while c.recv(1 << 16):
+	pass
+" $TMPDIR/events.sock &
+	while [ ! -S $TMPDIR/events.sock ]; do sleep 0.1; done
+	./bench-events unix:$TMPDIR/events.sock $RATE $SECONDS_PER_RUN
+	wait
+	rm -f $TMPDIR/events.sock
+done
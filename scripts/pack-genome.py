@@ -0,0 +1,81 @@
+#!/usr/bin/python
+# Pack a directory of genome samples into a single binary
+# expression matrix which can be memory-mapped by face-rec
+# with --data genome_bin.
+#
+# The file consists of a 64-byte header, the expression matrix
+# with one row per sample (dense float32 or CSR), and a list of
+# tab-separated "label name" entries, one per sample.
+import argparse
+import os
+import struct
+import sys
+import numpy as np
+
+MAGIC = "GMAT"
+VERSION = 1
+STORAGE_DENSE = 0
+STORAGE_CSR = 1
+HEADER_SIZE = 64
+
+# parse command-line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("INPUT", help="directory of samples (e.g. train_data)")
+parser.add_argument("OUTPUT", help="output file")
+parser.add_argument("--dtype", default="float64", help="data type of the sample files")
+parser.add_argument("--min_expr", type=float, default=0, help="remove genes with mean expression below this value", metavar="X")
+parser.add_argument("--genes", help="use the gene list of a previously packed file", metavar="FILE")
+parser.add_argument("--sparse", action="store_true", help="store the matrix in CSR format")
+parser.add_argument("--threshold", type=float, default=0, help="treat expression values at or below this value as zero", metavar="X")
+
+args = parser.parse_args()
+
+# load samples
+filenames = sorted(os.listdir(args.INPUT))
+
+if len(filenames) == 0:
+	print "error: no samples found in %s" % args.INPUT
+	sys.exit(1)
+
+X = np.vstack([np.fromfile(os.path.join(args.INPUT, f), dtype=args.dtype) for f in filenames]).astype(np.float32)
+
+# select genes, reusing the gene list of the training set if given,
+# so that the training set and test set have the same dimensions
+if args.genes:
+	genes = np.load(args.genes + ".genes.npy")
+else:
+	genes = np.where(X.mean(axis=0) >= args.min_expr)[0]
+
+X = X[:, genes]
+X[X <= args.threshold] = 0
+
+# construct entries
+entries = "".join("%s\t%s\n" % (f.split("_")[0], f) for f in filenames)
+
+# write matrix
+num_samples, num_genes = X.shape
+
+with open(args.OUTPUT, "wb") as f:
+	if args.sparse:
+		rows, cols = np.nonzero(X)
+		row_ptr = np.zeros(num_samples + 1, dtype=np.int64)
+		row_ptr[1:] = np.cumsum(np.bincount(rows, minlength=num_samples))
+		values = X[rows, cols]
+		data = row_ptr.tobytes() + cols.astype(np.int32).tobytes() + values.astype(np.float32).tobytes()
+		storage = STORAGE_CSR
+		nnz = len(values)
+	else:
+		data = X.tobytes()
+		storage = STORAGE_DENSE
+		nnz = X.size
+
+	entries_offset = HEADER_SIZE + len(data)
+	header = struct.pack("<4siiiiiqqqq", MAGIC, VERSION, storage, num_samples, num_genes, 0, nnz, HEADER_SIZE, entries_offset, len(entries))
+
+	f.write(header.ljust(HEADER_SIZE, "\0"))
+	f.write(data)
+	f.write(entries)
+
+np.save(args.OUTPUT + ".genes.npy", genes)
+
+print "%d samples, %d genes, %d nonzeros (%.1f%%), %.2f MB" % (num_samples, num_genes, nnz, 100.0 * nnz / X.size, os.path.getsize(args.OUTPUT) / 1e6)
@@ -43,6 +43,10 @@ while [[ $# -gt 0 ]]; do
 		PARAM="$2"
 		shift
 		;;
+	-s|--solver)
+		ARGS="$ARGS --solver $2"
+		shift
+		;;
 	--start)
 		TEST_START="$2"
 		shift
@@ -73,8 +77,9 @@ if [[ -z $DATASET || -z $ALGO || -z $PARAM ]]; then
 	>&2 echo "  -t, --train     training partition (0-100)"
 	>&2 echo "  -r, --test      testing partition (0-100)"
 	>&2 echo "  -i, --num_iter  number of iterations"
-	>&2 echo "  -a, --algo      algorithm (pca, lda, ica)"
+	>&2 echo "  -a, --algo      algorithm (pca, lda, ica, rp)"
 	>&2 echo "  -p, --param     hyperparameter"
+	>&2 echo "  -s, --solver    eigensolver (full, lanczos)"
 	>&2 echo "  --start         hyperparameter start"
 	>&2 echo "  --end           hyperparameter stop"
 	>&2 echo "  --inc           hyperparameter increment"
@@ -86,19 +91,36 @@ if [ $PARAM = "ica_nonl" ]; then
 	VALUES="tanh gauss pow3"
 elif [ $PARAM = "knn_dist" ]; then
 	VALUES="COS L1 L2"
+elif [ $PARAM = "knn_layout" ]; then
+	VALUES="column block8 block16"
+elif [ $PARAM = "bayes_batch" ]; then
+	VALUES="0 1 16 64 256"
+elif [ $PARAM = "lda_batch" ]; then
+	VALUES="0 16 64 256 1024"
+elif [ $PARAM = "solver" ]; then
+	VALUES="full lanczos"
+elif [ $PARAM = "threads" ]; then
+	VALUES="1 2 4 8"
+elif [[ $PARAM == *_energy ]]; then
+	VALUES="0.8 0.85 0.9 0.95 0.99"
 else
 	for (( i = $TEST_START; i <= $TEST_END; i += $TEST_INC )); do
 		VALUES="$VALUES $i"
 	done
 fi
 
+# use the Bayes classifier for Bayes hyperparameters
+if [[ $PARAM == bayes_* ]]; then
+	ARGS="$ARGS --clas bayes"
+fi
+
 # default hyperparameters for FERET
 if [ $DATASET = "feret" ]; then
-	if [ $PARAM != "pca_n1" ]; then
+	if [[ $PARAM != "pca_n1" && $PARAM != "pca_energy" ]]; then
 		ARGS="$ARGS --pca_n1 100"
 	fi
 
-	if [ $PARAM != "lda_n1" ]; then
+	if [[ $PARAM != "lda_n1" && $PARAM != "lda_energy" ]]; then
 		ARGS="$ARGS --lda_n1 100"
 	fi
 
@@ -106,13 +128,17 @@ if [ $DATASET = "feret" ]; then
 		ARGS="$ARGS --lda_n2 100"
 	fi
 
-	if [ $PARAM != "ica_n1" ]; then
+	if [[ $PARAM != "ica_n1" && $PARAM != "ica_energy" ]]; then
 		ARGS="$ARGS --ica_n1 100"
 	fi
 
 	if [ $PARAM != "ica_n2" ]; then
 		ARGS="$ARGS --ica_n2 100"
 	fi
+
+	if [ $PARAM != "rp_n" ]; then
+		ARGS="$ARGS --rp_n 100"
+	fi
 fi
 
 # build executable
@@ -120,7 +146,7 @@ make GPU=$GPU > /dev/null
 
 # run experiment
 for N in $VALUES; do
-	RESULTS=$(python ./scripts/cross-validate.py -d $DATASET -t $TRAIN -r $TEST -i $NUM_ITER -- --$ALGO --$PARAM $N $ARGS)
+	RESULTS=$(python ./scripts/cross-validate.py -d $DATASET -t $TRAIN -r $TEST -i $NUM_ITER -- --feat $ALGO --$PARAM $N $ARGS)
 
 	echo $N $RESULTS
 done
@@ -0,0 +1,339 @@
+/**
+ * @file batchbayeslayer.cpp
+ *
+ * Implementation of the batched Bayes layer.
+ *
+ * Each class is modeled as a Gaussian with a regularized covariance
+ * matrix. The inverse Cholesky factor W = L^-1 and the log-determinant
+ * of each covariance matrix are computed once when the layer is fitted,
+ * so that the discriminant of a class reduces to
+ *
+ *   g(x) = ||W * x - W * mu||^2 + log|S|
+ *
+ * Queries are evaluated in batches, which turns the evaluation of each
+ * class into a triangular matrix product over the whole batch.
+ *
+ * Classifier layers are not stored in a model file, so the factors are
+ * recomputed from the stored projections whenever a model is loaded.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "batchbayeslayer.h"
+#include "linalg.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Get the offset of a row in a packed lower-triangular matrix.
+ *
+ * @param i
+ */
+inline size_t tri_row(int i)
+{
+	return (size_t) i * (i + 1) / 2;
+}
+
+
+
+/**
+ * Construct a batched Bayes layer.
+ *
+ * @param batch
+ * @param reg
+ * @param threshold
+ */
+BatchBayesLayer::BatchBayesLayer(int batch, float reg, float threshold)
+{
+	_batch = batch;
+	_reg = reg;
+	_threshold = threshold;
+
+	_num_dims = 0;
+	_num_classes = 0;
+
+	_num_queries = 0;
+}
+
+
+
+/**
+ * Compute the discriminant of each class for a batch of samples.
+ * The batch is stored with one row per dimension, so that the
+ * inner loop runs across samples.
+ *
+ * @param X
+ * @param n
+ * @param D
+ */
+void BatchBayesLayer::score_batch(const std::vector<float>& X, int n, std::vector<float>& D) const
+{
+	const size_t tri_size = tri_row(_num_dims);
+	std::vector<float> z(n);
+
+	D.resize((size_t) _num_classes * n);
+
+	for ( int k = 0; k < _num_classes; k++ ) {
+		const float *W_k = &_W[k * tri_size];
+		const float *b_k = &_b[(size_t) k * _num_dims];
+		float *D_k = &D[(size_t) k * n];
+
+		std::fill(D_k, D_k + n, _logdet[k]);
+
+		for ( int i = 0; i < _num_dims; i++ ) {
+			const float *W_i = &W_k[tri_row(i)];
+
+			std::fill(z.begin(), z.end(), -b_k[i]);
+
+			for ( int j = 0; j <= i; j++ ) {
+				const float *X_j = &X[(size_t) j * n];
+				float w = W_i[j];
+
+				for ( int q = 0; q < n; q++ ) {
+					z[q] += w * X_j[q];
+				}
+			}
+
+			for ( int q = 0; q < n; q++ ) {
+				D_k[q] += z[q] * z[q];
+			}
+		}
+	}
+}
+
+
+
+/**
+ * Compute the Gaussian model of each class.
+ *
+ * Each covariance matrix is regularized by adding a multiple of
+ * the average variance of the training set to the diagonal, since
+ * there are usually fewer samples per class than dimensions.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void BatchBayesLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	int n = X.cols();
+	int d = X.rows();
+
+	_num_dims = d;
+	_num_classes = c;
+	_W.resize(c * tri_row(d));
+	_b.resize((size_t) c * d);
+	_logdet.resize(c);
+
+	// compute the average variance of the training set
+	double var = 0;
+
+	for ( int j = 0; j < d; j++ ) {
+		double mean = 0;
+		double sum = 0;
+
+		for ( int i = 0; i < n; i++ ) {
+			mean += X.elem(j, i);
+		}
+		mean /= n;
+
+		for ( int i = 0; i < n; i++ ) {
+			double t = X.elem(j, i) - mean;
+			sum += t * t;
+		}
+
+		var += sum / std::max(n - 1, 1);
+	}
+
+	var = std::max(var / d, 1e-12);
+
+	// compute the model of each class
+	for ( int k = 0; k < c; k++ ) {
+		std::vector<int> indices;
+
+		for ( int i = 0; i < n; i++ ) {
+			if ( y[i] == k ) {
+				indices.push_back(i);
+			}
+		}
+
+		int n_k = indices.size();
+
+		// compute mean
+		std::vector<double> mu(d, 0.0);
+
+		for ( int i : indices ) {
+			for ( int j = 0; j < d; j++ ) {
+				mu[j] += X.elem(j, i);
+			}
+		}
+
+		for ( int j = 0; j < d; j++ ) {
+			mu[j] /= std::max(n_k, 1);
+		}
+
+		// compute lower triangle of covariance
+		std::vector<double> S((size_t) d * d, 0.0);
+		std::vector<double> x(d);
+
+		for ( int i : indices ) {
+			for ( int j = 0; j < d; j++ ) {
+				x[j] = X.elem(j, i) - mu[j];
+			}
+
+			for ( int r = 0; r < d; r++ ) {
+				for ( int j = 0; j <= r; j++ ) {
+					S[(size_t) r * d + j] += x[r] * x[j];
+				}
+			}
+		}
+
+		for ( int r = 0; r < d; r++ ) {
+			for ( int j = 0; j <= r; j++ ) {
+				S[(size_t) r * d + j] /= std::max(n_k - 1, 1);
+			}
+		}
+
+		// factor the regularized covariance, increasing the
+		// regularization until it is positive definite
+		std::vector<double> L;
+		double reg = std::max((double) _reg, 1e-6) * var;
+
+		do {
+			L = S;
+
+			for ( int j = 0; j < d; j++ ) {
+				L[(size_t) j * d + j] += reg;
+			}
+
+			reg *= 10;
+		} while ( !cholesky(L, d) );
+
+		// compute log-determinant and inverse factor
+		double logdet = 0;
+
+		for ( int j = 0; j < d; j++ ) {
+			logdet += 2 * log(L[(size_t) j * d + j]);
+		}
+
+		tri_inverse(L, d);
+
+		float *W_k = &_W[k * tri_row(d)];
+		float *b_k = &_b[(size_t) k * d];
+
+		for ( int r = 0; r < d; r++ ) {
+			double sum = 0;
+
+			for ( int j = 0; j <= r; j++ ) {
+				W_k[tri_row(r) + j] = L[(size_t) r * d + j];
+				sum += L[(size_t) r * d + j] * mu[j];
+			}
+
+			b_k[r] = sum;
+		}
+
+		_logdet[k] = logdet;
+	}
+}
+
+
+
+/**
+ * Classify a set of samples in batches.
+ *
+ * The distance of a match is the Mahalanobis distance to the
+ * predicted class, and the margin is the difference between the
+ * discriminants of the predicted class and the next best class.
+ *
+ * @param X_test
+ */
+std::vector<int> BatchBayesLayer::predict(const Matrix& X_test)
+{
+	assert(X_test.rows() == _num_dims);
+
+	int n = X_test.cols();
+	std::vector<int> y_pred(n);
+	std::vector<float> X;
+	std::vector<float> D;
+
+	_matches.resize(n);
+
+	for ( int q0 = 0; q0 < n; q0 += _batch ) {
+		int n_b = std::min(_batch, n - q0);
+
+		// load batch with one row per dimension
+		X.resize((size_t) _num_dims * n_b);
+
+		for ( int j = 0; j < _num_dims; j++ ) {
+			for ( int q = 0; q < n_b; q++ ) {
+				X[(size_t) j * n_b + q] = X_test.elem(j, q0 + q);
+			}
+		}
+
+		score_batch(X, n_b, D);
+
+		// select the best class for each sample
+		for ( int q = 0; q < n_b; q++ ) {
+			float best = std::numeric_limits<float>::infinity();
+			float second = best;
+			int y_best = 0;
+
+			for ( int k = 0; k < _num_classes; k++ ) {
+				float g = D[(size_t) k * n_b + q];
+
+				if ( g < best ) {
+					second = best;
+					best = g;
+					y_best = k;
+				}
+				else if ( g < second ) {
+					second = g;
+				}
+			}
+
+			float dist = sqrtf(std::max(best - _logdet[y_best], 0.0f));
+			int y = (_threshold > 0 && dist > _threshold) ? -1 : y_best;
+
+			_matches[q0 + q] = Match { y, dist, second - best };
+			y_pred[q0 + q] = y;
+		}
+	}
+
+	_num_queries += n;
+
+	return y_pred;
+}
+
+
+
+/**
+ * Print information about a batched Bayes layer.
+ */
+void BatchBayesLayer::print()
+{
+	log(LogLevel::Verbose, "Bayes (batched)");
+	log(LogLevel::Verbose, "  %-20s  %10d", "batch", _batch);
+	log(LogLevel::Verbose, "  %-20s  %10f", "reg", _reg);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print evaluation statistics.
+ */
+void BatchBayesLayer::print_stats()
+{
+	if ( _num_queries == 0 ) {
+		return;
+	}
+
+	long flops = (long) _num_queries * _num_classes * (_num_dims + 1) * _num_dims;
+
+	log(LogLevel::Info, "bayes: %ld queries, %d classes, %.2f GFLOP", _num_queries, _num_classes, flops * 1e-9);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file batchbayeslayer.h
+ *
+ * Interface definitions for the batched Bayes layer.
+ */
+#ifndef BATCHBAYESLAYER_H
+#define BATCHBAYESLAYER_H
+
+#include <mlearn.h>
+#include <vector>
+#include "matchlayer.h"
+
+
+
+class BatchBayesLayer : public MatchLayer {
+private:
+	int _batch;
+	float _reg;
+	float _threshold;
+
+	int _num_dims;
+	int _num_classes;
+	std::vector<float> _W;
+	std::vector<float> _b;
+	std::vector<float> _logdet;
+
+	long _num_queries;
+
+	void score_batch(const std::vector<float>& X, int n, std::vector<float>& D) const;
+
+public:
+	BatchBayesLayer(int batch, float reg, float threshold);
+	~BatchBayesLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	std::vector<int> predict(const ML::Matrix& X_test);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
@@ -3,12 +3,116 @@
  *
  * Implementation of the bounding-box iterator.
  */
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <opencv2/imgproc/imgproc.hpp>
 #include "bboxiterator.h"
 
 
 
+/**
+ * Compute the quality score of a face crop in [0, 1], which is
+ * the product of three factors:
+ *
+ *   sharpness:  variance of the Laplacian of the crop
+ *   brightness: distance of the mean intensity from mid-gray
+ *   size:       size of the face in the original image
+ *
+ * The crop is evaluated after resizing, so that sharpness is
+ * comparable between faces of different sizes.
+ *
+ * @param face
+ * @param rect
+ */
+float face_quality(const cv::Mat& face, const cv::Rect& rect)
+{
+   const double SHARP_VAR = 100;
+   const int MIN_SIZE = 80;
+
+   cv::Mat gray;
+   cv::Mat laplacian;
+   cv::Scalar lap_mean, lap_stddev;
+
+   cv::cvtColor(face, gray, CV_BGR2GRAY);
+   cv::Laplacian(gray, laplacian, CV_64F);
+   cv::meanStdDev(laplacian, lap_mean, lap_stddev);
+
+   float sharpness = std::min(lap_stddev[0] * lap_stddev[0] / SHARP_VAR, 1.0);
+   float brightness = 1 - fabs(cv::mean(gray)[0] - 128) / 128;
+   float size = std::min((float) std::min(rect.width, rect.height) / MIN_SIZE, 1.0f);
+
+   return sharpness * brightness * size;
+}
+
+
+
+/**
+ * Compute the difference hash of a face crop. The crop is reduced
+ * to a 9x8 grayscale thumbnail, and each bit of the hash records
+ * whether a pixel is brighter than its right neighbor. Crops which
+ * look alike have hashes with a small Hamming distance.
+ *
+ * @param face
+ */
+uint64_t face_hash(const cv::Mat& face)
+{
+   cv::Mat gray;
+   cv::Mat thumb;
+
+   cv::cvtColor(face, gray, CV_BGR2GRAY);
+   cv::resize(gray, thumb, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+   uint64_t hash = 0;
+
+   for ( int i = 0; i < 8; i++ ) {
+      for ( int j = 0; j < 8; j++ ) {
+         hash = (hash << 1) | (thumb.at<unsigned char>(i, j) > thumb.at<unsigned char>(i, j + 1));
+      }
+   }
+
+   return hash;
+}
+
+
+
+/**
+ * Determine the image shape of a packed sample, in which pixels
+ * are stored in row-major order with interleaved channels. If the
+ * width and height are zero, the image is assumed to be square,
+ * and grayscale if possible. Returns false if the sample size does
+ * not match the shape.
+ *
+ * @param num_dims
+ * @param width
+ * @param height
+ * @param channels
+ */
+bool image_shape(int num_dims, int& width, int& height, int& channels)
+{
+   if ( width == 0 && height == 0 ) {
+      for ( int c : { 1, 3 } ) {
+         int size = lround(sqrt(num_dims / c));
+
+         if ( size * size * c == num_dims ) {
+            width = size;
+            height = size;
+            break;
+         }
+      }
+   }
+
+   if ( width <= 0 || height <= 0 || num_dims % (width * height) != 0 ) {
+      return false;
+   }
+
+   channels = num_dims / (width * height);
+
+   return true;
+}
+
+
+
 /**
  * Construct a bounding-box iterator from an image
  * and a list of bounding boxes.
@@ -28,6 +132,7 @@ BBoxIterator::BBoxIterator(const cv::Mat& image, const std::vector<cv::Rect>& re
       cv::resize(face, face, size);
 
       _faces.push_back(face);
+      _rects.push_back(rect);
 
       // append empty entry
       _entries.push_back(ML::DataEntry { "", "" });
@@ -36,6 +141,99 @@ BBoxIterator::BBoxIterator(const cv::Mat& image, const std::vector<cv::Rect>& re
 
 
 
+/**
+ * Construct a bounding-box iterator from a list of face
+ * crops which have already been resized.
+ *
+ * @param faces
+ */
+BBoxIterator::BBoxIterator(const std::vector<cv::Mat>& faces)
+{
+   _channels = faces.empty() ? 3 : faces[0].channels();
+   _size = faces.empty() ? cv::Size() : faces[0].size();
+   _faces = faces;
+
+   for ( auto& face : faces ) {
+      _rects.push_back(cv::Rect(0, 0, face.cols, face.rows));
+      _entries.push_back(ML::DataEntry { "", "" });
+   }
+}
+
+
+
+/**
+ * Get the quality score of each face. The scores are computed
+ * on the first call, so that they cost nothing unless they are
+ * used, as with --quality_min and --quality_topk.
+ */
+const std::vector<float>& BBoxIterator::quality()
+{
+   if ( _quality.empty() ) {
+      for ( size_t i = 0; i < _faces.size(); i++ ) {
+         _quality.push_back(face_quality(_faces[i], _rects[i]));
+      }
+   }
+
+   return _quality;
+}
+
+
+
+/**
+ * Get the difference hash of each face. The hashes are computed
+ * on the first call, so that they cost nothing unless they are
+ * used, as with --hash_ttl.
+ */
+const std::vector<uint64_t>& BBoxIterator::hashes()
+{
+   if ( _hashes.empty() ) {
+      for ( auto& face : _faces ) {
+         _hashes.push_back(face_hash(face));
+      }
+   }
+
+   return _hashes;
+}
+
+
+
+/**
+ * Keep only the faces with the given indices. Quality scores
+ * and hashes which have already been computed are kept as well.
+ *
+ * @param indices
+ */
+void BBoxIterator::select(const std::vector<int>& indices)
+{
+   std::vector<ML::DataEntry> entries;
+   std::vector<cv::Mat> faces;
+   std::vector<cv::Rect> rects;
+   std::vector<float> quality;
+   std::vector<uint64_t> hashes;
+
+   for ( int i : indices ) {
+      entries.push_back(_entries[i]);
+      faces.push_back(_faces[i]);
+      rects.push_back(_rects[i]);
+
+      if ( !_quality.empty() ) {
+         quality.push_back(_quality[i]);
+      }
+
+      if ( !_hashes.empty() ) {
+         hashes.push_back(_hashes[i]);
+      }
+   }
+
+   _entries = entries;
+   _faces = faces;
+   _rects = rects;
+   _quality = quality;
+   _hashes = hashes;
+}
+
+
+
 void BBoxIterator::sample(ML::Matrix& X, int i)
 {
    assert(X.rows() == this->sample_size());
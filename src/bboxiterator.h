@@ -6,11 +6,16 @@
 #ifndef BBOXITERATOR_H
 #define BBOXITERATOR_H
 
+#include <cstdint>
 #include <mlearn.h>
 #include <opencv2/core/core.hpp>
 
 
 
+bool image_shape(int num_dims, int& width, int& height, int& channels);
+
+
+
 class BBoxIterator : public ML::DataIterator {
 private:
    std::vector<ML::DataEntry> _entries;
@@ -18,15 +23,22 @@ private:
    int _channels;
    cv::Size _size;
    std::vector<cv::Mat> _faces;
+   std::vector<cv::Rect> _rects;
+   std::vector<float> _quality;
+   std::vector<uint64_t> _hashes;
 
 public:
    BBoxIterator(const cv::Mat& image, const std::vector<cv::Rect>& rects, cv::Size size);
+   BBoxIterator(const std::vector<cv::Mat>& faces);
    ~BBoxIterator() {};
 
    int num_samples() const { return _entries.size(); }
    int sample_size() const { return _channels * _size.width * _size.height; }
    const std::vector<ML::DataEntry>& entries() const { return _entries; }
+   const std::vector<float>& quality();
+   const std::vector<uint64_t>& hashes();
 
+   void select(const std::vector<int>& indices);
    void sample(ML::Matrix& X, int i);
 };
 
@@ -0,0 +1,82 @@
+/**
+ * @file benchevents.cpp
+ *
+ * Throughput benchmark of the recognition event sink.
+ *
+ * The benchmark pushes synthetic events into an event sink at a fixed
+ * rate for a fixed duration, in bursts of one millisecond, and reports
+ * the statistics of the sink along with the time spent in push(), which
+ * is the only cost of the sink to the recognition thread.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mlearn.h>
+#include <thread>
+#include "eventsink.h"
+
+
+
+using namespace ML;
+
+
+
+int main(int argc, char **argv)
+{
+	if ( argc != 4 ) {
+		std::cerr << "usage: ./bench-events PATH RATE SECONDS\n";
+		exit(1);
+	}
+
+	std::string path = argv[1];
+	int rate = atoi(argv[2]);
+	float seconds = atof(argv[3]);
+
+	if ( rate <= 0 || seconds <= 0 ) {
+		std::cerr << "error: RATE and SECONDS must be positive\n";
+		exit(1);
+	}
+
+	const auto BURST_INTERVAL = std::chrono::milliseconds(1);
+	const int NUM_BURSTS = seconds * 1000;
+
+	EventSink events(path, "bench");
+	float push_time = 0;
+	float push_max = 0;
+	long num_events = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for ( int b = 0; b < NUM_BURSTS; b++ ) {
+		// push the events which are due by the end of this burst
+		long num_due = (long) rate * (b + 1) / 1000;
+
+		for ( ; num_events < num_due; num_events++ ) {
+			double timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			event_t event { timestamp, (int) (num_events % 16), cv::Rect(100, 100, 80, 80), "bench", 0.5f };
+
+			auto push_start = std::chrono::steady_clock::now();
+
+			events.push(event);
+
+			float t = std::chrono::duration<float>(std::chrono::steady_clock::now() - push_start).count();
+
+			push_time += t;
+			push_max = std::max(push_max, t);
+		}
+
+		std::this_thread::sleep_until(start + (b + 1) * BURST_INTERVAL);
+	}
+
+	events.close();
+	events.print_stats();
+
+	log(LogLevel::Info, "push: %ld events at %d events/s, %.3f us mean, %.3f us max",
+		num_events,
+		rate,
+		(num_events > 0) ? 1e6 * push_time / num_events : 0.0f,
+		1e6 * push_max);
+
+	return 0;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file cachedfeaturelayer.cpp
+ *
+ * Implementation of the cached feature layer.
+ *
+ * The layer wraps another feature layer and stores the fitted layer
+ * in a cache directory, keyed by a hash of the training data and the
+ * hyperparameters of the layer. When the same layer is fitted on the
+ * same training data again, for example in experiments which only
+ * vary the classifier, the fitted layer is loaded from the cache
+ * instead of being recomputed.
+ */
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+#include "cachedfeaturelayer.h"
+
+
+
+using namespace ML;
+
+
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+
+
+/**
+ * Update an FNV-1a hash with a block of bytes.
+ *
+ * @param h
+ * @param data
+ * @param size
+ */
+inline uint64_t fnv_update(uint64_t h, const void *data, size_t size)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+
+	for ( size_t i = 0; i < size; i++ ) {
+		h = (h ^ p[i]) * FNV_PRIME;
+	}
+
+	return h;
+}
+
+
+
+/**
+ * Construct a cached feature layer. The cached layer takes
+ * ownership of the wrapped layer.
+ *
+ * @param layer
+ * @param dir
+ * @param key
+ */
+CachedFeatureLayer::CachedFeatureLayer(FeatureLayer *layer, const std::string& dir, const std::string& key)
+{
+	_layer.reset(layer);
+	_dir = dir;
+	_key = key;
+
+	_hit = false;
+	_compute_time = 0;
+	_load_time = 0;
+	_hash_time = 0;
+}
+
+
+
+/**
+ * Compute the hash of a training set, which covers a key
+ * string, the samples and the labels. The hash identifies
+ * the cache entry of a fitted layer, and also matches an
+ * ICA checkpoint to its training run.
+ *
+ * @param key
+ * @param X
+ * @param y
+ * @param c
+ */
+uint64_t hash_training_set(const std::string& key, const Matrix& X, const std::vector<int>& y, int c)
+{
+	int rows = X.rows();
+	int cols = X.cols();
+	uint64_t h = FNV_OFFSET;
+
+	h = fnv_update(h, key.data(), key.size());
+	h = fnv_update(h, &rows, sizeof(int));
+	h = fnv_update(h, &cols, sizeof(int));
+	h = fnv_update(h, &c, sizeof(int));
+	h = fnv_update(h, y.data(), y.size() * sizeof(int));
+
+	for ( int i = 0; i < cols; i++ ) {
+		for ( int j = 0; j < rows; j++ ) {
+			float x = X.elem(j, i);
+
+			h = fnv_update(h, &x, sizeof(float));
+		}
+	}
+
+	return h;
+}
+
+
+
+/**
+ * Compute the hash of the contents of a file, for example
+ * to match the results of a scan to the model which produced
+ * them.
+ *
+ * @param path
+ */
+uint64_t hash_file(const std::string& path)
+{
+	std::ifstream file(path, std::ifstream::in | std::ifstream::binary);
+
+	if ( !file.is_open() ) {
+		std::cerr << "error: could not open " << path << "\n";
+		exit(1);
+	}
+
+	std::vector<char> buffer(1 << 16);
+	uint64_t h = FNV_OFFSET;
+
+	while ( file.good() ) {
+		file.read(buffer.data(), buffer.size());
+		h = fnv_update(h, buffer.data(), file.gcount());
+	}
+
+	return h;
+}
+
+
+
+/**
+ * Load the wrapped layer from the cache. Returns false if
+ * the cache entry does not exist or belongs to another key.
+ */
+bool CachedFeatureLayer::load_cache()
+{
+	std::ifstream file(_path, std::ifstream::in | std::ifstream::binary);
+
+	if ( !file.is_open() ) {
+		return false;
+	}
+
+	int key_size;
+
+	file.read(reinterpret_cast<char *>(&key_size), sizeof(int));
+
+	if ( !file || key_size != (int) _key.size() ) {
+		return false;
+	}
+
+	std::string key(key_size, '\0');
+
+	file.read(&key[0], key_size);
+
+	if ( key != _key ) {
+		return false;
+	}
+
+	file.read(reinterpret_cast<char *>(&_compute_time), sizeof(float));
+
+	_layer->load(file);
+
+	return true;
+}
+
+
+
+/**
+ * Save the wrapped layer to the cache. The entry is written
+ * to a temporary file and renamed, so that concurrent runs
+ * never read a partial entry.
+ */
+void CachedFeatureLayer::save_cache()
+{
+	if ( mkdir(_dir.c_str(), 0775) != 0 && errno != EEXIST ) {
+		std::cerr << "warning: could not create cache directory " << _dir << "\n";
+		return;
+	}
+
+	std::string tmp_path = _path + ".tmp";
+	std::ofstream file(tmp_path, std::ofstream::out | std::ofstream::binary);
+	int key_size = _key.size();
+
+	file.write(reinterpret_cast<const char *>(&key_size), sizeof(int));
+	file.write(_key.data(), key_size);
+	file.write(reinterpret_cast<const char *>(&_compute_time), sizeof(float));
+
+	_layer->save(file);
+	file.close();
+
+	if ( !file || rename(tmp_path.c_str(), _path.c_str()) != 0 ) {
+		std::cerr << "warning: could not write cache entry " << _path << "\n";
+	}
+}
+
+
+
+/**
+ * Compute the wrapped layer, or load it from the cache
+ * if it has already been computed for this training set.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void CachedFeatureLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 ".dat", hash_training_set(_key, X, y, c));
+
+	_path = _dir + "/" + name;
+
+	auto mid = std::chrono::steady_clock::now();
+
+	_hash_time = std::chrono::duration<float>(mid - start).count();
+	_hit = load_cache();
+
+	auto end = std::chrono::steady_clock::now();
+
+	if ( _hit ) {
+		_load_time = std::chrono::duration<float>(end - mid).count();
+		return;
+	}
+
+	_layer->compute(X, y, c);
+
+	_compute_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - end).count();
+
+	save_cache();
+}
+
+
+
+/**
+ * Project a matrix with the wrapped layer.
+ *
+ * @param X
+ */
+Matrix CachedFeatureLayer::project(const Matrix& X)
+{
+	return _layer->project(X);
+}
+
+
+
+/**
+ * Save the wrapped layer to a file.
+ *
+ * @param file
+ */
+void CachedFeatureLayer::save(std::ofstream& file)
+{
+	_layer->save(file);
+}
+
+
+
+/**
+ * Load the wrapped layer from a file.
+ *
+ * @param file
+ */
+void CachedFeatureLayer::load(std::ifstream& file)
+{
+	_layer->load(file);
+}
+
+
+
+/**
+ * Print information about a cached feature layer.
+ */
+void CachedFeatureLayer::print()
+{
+	_layer->print();
+
+	log(LogLevel::Verbose, "Cache");
+	log(LogLevel::Verbose, "  %-20s  %10s", "dir", _dir.c_str());
+	log(LogLevel::Verbose, "  %-20s  %10s", "key", _key.c_str());
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print cache statistics. On a hit, the time saved is the
+ * original compute time of the cached layer less the time
+ * spent hashing the training set and loading the layer.
+ */
+void CachedFeatureLayer::print_stats()
+{
+	if ( _path.empty() ) {
+		return;
+	}
+
+	if ( _hit ) {
+		log(LogLevel::Info, "cache: hit %s, saved %.3f s (hash %.3f s, load %.3f s)",
+			_path.c_str(),
+			_compute_time - _hash_time - _load_time,
+			_hash_time,
+			_load_time);
+	}
+	else {
+		log(LogLevel::Info, "cache: miss %s, computed in %.3f s (hash %.3f s)",
+			_path.c_str(),
+			_compute_time,
+			_hash_time);
+	}
+}
@@ -0,0 +1,54 @@
+/**
+ * @file cachedfeaturelayer.h
+ *
+ * Interface definitions for the cached feature layer.
+ */
+#ifndef CACHEDFEATURELAYER_H
+#define CACHEDFEATURELAYER_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mlearn.h>
+#include <string>
+#include <vector>
+
+
+
+class CachedFeatureLayer : public ML::FeatureLayer {
+private:
+	std::unique_ptr<ML::FeatureLayer> _layer;
+	std::string _dir;
+	std::string _key;
+
+	std::string _path;
+	bool _hit;
+	float _compute_time;
+	float _load_time;
+	float _hash_time;
+
+	bool load_cache();
+	void save_cache();
+
+public:
+	CachedFeatureLayer(ML::FeatureLayer *layer, const std::string& dir, const std::string& key);
+	~CachedFeatureLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+
+	void print();
+	void print_stats();
+};
+
+
+
+uint64_t hash_file(const std::string& path);
+uint64_t hash_training_set(const std::string& key, const ML::Matrix& X, const std::vector<int>& y, int c);
+
+
+
+#endif
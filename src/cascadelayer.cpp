@@ -0,0 +1,397 @@
+/**
+ * @file cascadelayer.cpp
+ *
+ * Implementation of the coarse-to-fine cascade layers.
+ *
+ * The cascade combines a cheap model, such as a low-dimensional PCA,
+ * with an expensive model, such as a high-dimensional LDA. Every query
+ * is first classified by the nearest class in the coarse feature space,
+ * which also yields a shortlist of the closest classes and the relative
+ * margin between the two closest classes. A query with a large margin
+ * is answered by the coarse model; only an ambiguous query is projected
+ * into the fine feature space and re-scored against the samples of its
+ * shortlist. Since projection dominates the cost of the fine model,
+ * most of that cost is paid only for the escalated queries.
+ *
+ * The two feature layers form the feature layer of the model, so that
+ * both are stored in the model file. The feature layer projects a data
+ * matrix with the coarse layer and stacks the projection on top of the
+ * data itself, and the cascade classifier splits the two parts. The
+ * fine projection is deferred to the classifier, which applies it to
+ * the training set and to the escalated queries only. Both stages rank
+ * classes with the chunked, early-abandoning search of the gallery.
+ */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include "cascadelayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Copy a range of rows of a data matrix.
+ *
+ * @param X
+ * @param begin
+ * @param end
+ */
+Matrix slice_rows(const Matrix& X, int begin, int end)
+{
+	Matrix Y(end - begin, X.cols());
+
+	for ( int i = 0; i < X.cols(); i++ ) {
+		for ( int j = begin; j < end; j++ ) {
+			Y.elem(j - begin, i) = X.elem(j, i);
+		}
+	}
+
+	return Y;
+}
+
+
+
+/**
+ * Construct a cascade feature layer. A null feature
+ * layer is treated as the identity.
+ *
+ * @param coarse
+ * @param fine
+ */
+CascadeFeatureLayer::CascadeFeatureLayer(FeatureLayer *coarse, FeatureLayer *fine)
+{
+	_coarse.reset(coarse);
+	_fine.reset(fine);
+	_num_dims = 0;
+}
+
+
+
+/**
+ * Fit both feature layers.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void CascadeFeatureLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	if ( _coarse ) {
+		_coarse->compute(X, y, c);
+	}
+
+	if ( _fine ) {
+		_fine->compute(X, y, c);
+	}
+
+	_num_dims = X.rows();
+}
+
+
+
+/**
+ * Project a data matrix with the coarse layer, and stack the
+ * projection on top of the data, which the last num_dims()
+ * rows of the result hold for the fine layer.
+ *
+ * @param X
+ */
+Matrix CascadeFeatureLayer::project(const Matrix& X)
+{
+	assert(X.rows() == _num_dims);
+
+	Matrix P_coarse = _coarse ? _coarse->project(X) : X;
+	Matrix P(P_coarse.rows() + X.rows(), X.cols());
+
+	for ( int i = 0; i < X.cols(); i++ ) {
+		for ( int j = 0; j < P_coarse.rows(); j++ ) {
+			P.elem(j, i) = P_coarse.elem(j, i);
+		}
+
+		for ( int j = 0; j < X.rows(); j++ ) {
+			P.elem(P_coarse.rows() + j, i) = X.elem(j, i);
+		}
+	}
+
+	return P;
+}
+
+
+
+/**
+ * Project a data matrix with the fine layer.
+ *
+ * @param X
+ */
+Matrix CascadeFeatureLayer::project_fine(const Matrix& X)
+{
+	return _fine ? _fine->project(X) : X;
+}
+
+
+
+/**
+ * Save a cascade feature layer to a file.
+ *
+ * @param file
+ */
+void CascadeFeatureLayer::save(std::ofstream& file)
+{
+	file.write(reinterpret_cast<const char *>(&_num_dims), sizeof(int));
+
+	if ( _coarse ) {
+		_coarse->save(file);
+	}
+
+	if ( _fine ) {
+		_fine->save(file);
+	}
+}
+
+
+
+/**
+ * Load a cascade feature layer from a file.
+ *
+ * @param file
+ */
+void CascadeFeatureLayer::load(std::ifstream& file)
+{
+	file.read(reinterpret_cast<char *>(&_num_dims), sizeof(int));
+
+	if ( _coarse ) {
+		_coarse->load(file);
+	}
+
+	if ( _fine ) {
+		_fine->load(file);
+	}
+}
+
+
+
+/**
+ * Print information about a cascade feature layer.
+ */
+void CascadeFeatureLayer::print()
+{
+	log(LogLevel::Verbose, "Coarse:");
+
+	if ( _coarse ) {
+		_coarse->print();
+	}
+
+	log(LogLevel::Verbose, "Fine:");
+
+	if ( _fine ) {
+		_fine->print();
+	}
+}
+
+
+
+/**
+ * Construct a cascade layer. The feature layer of the model
+ * provides the fine projection and is not owned by the cascade.
+ * The gallery of each stage is searched with the given chunk
+ * and block sizes.
+ *
+ * @param feature
+ * @param dist
+ * @param margin
+ * @param shortlist
+ * @param chunk
+ * @param block
+ */
+CascadeLayer::CascadeLayer(CascadeFeatureLayer *feature, MatchDist dist, float margin, int shortlist, int chunk, int block)
+	: _coarse(1, dist, 0, chunk, block, 0, 0),
+	  _fine(1, dist, 0, chunk, block, 0, 0)
+{
+	_feature = feature;
+	_margin = margin;
+	_shortlist = shortlist;
+
+	_num_classes = 0;
+
+	_num_queries = 0;
+	_num_escalated = 0;
+	_coarse_time = 0;
+	_fine_time = 0;
+}
+
+
+
+/**
+ * Compute the relative margin of a class ranking, which is
+ * the gap between the two closest classes relative to the
+ * distance of the second class.
+ *
+ * @param ranking
+ */
+inline float relative_margin(const std::vector<std::pair<float, int>>& ranking)
+{
+	if ( ranking.size() < 2 || ranking[1].first <= 0 ) {
+		return 1;
+	}
+
+	return (ranking[1].first - ranking[0].first) / ranking[1].first;
+}
+
+
+
+/**
+ * Create a match from a class ranking.
+ *
+ * @param ranking
+ */
+inline Match ranking_match(const std::vector<std::pair<float, int>>& ranking)
+{
+	return Match {
+		ranking[0].second,
+		ranking[0].first,
+		(ranking.size() > 1) ? ranking[1].first - ranking[0].first : 0
+	};
+}
+
+
+
+/**
+ * Store the coarse projection of the training set in the
+ * coarse gallery, and project the training set with the fine
+ * layer into the fine gallery.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void CascadeLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	int m = X.rows() - _feature->num_dims();
+
+	_coarse.compute(slice_rows(X, 0, m), y, c);
+	_fine.compute(_feature->project_fine(slice_rows(X, m, X.rows())), y, c);
+	_num_classes = c;
+}
+
+
+
+/**
+ * Classify a set of samples with the cascade.
+ *
+ * @param X_test
+ */
+std::vector<int> CascadeLayer::predict(const Matrix& X_test)
+{
+	int n = X_test.cols();
+	int m = X_test.rows() - _feature->num_dims();
+	std::vector<int> y_pred(n);
+	std::vector<std::vector<bool>> shortlists;
+	std::vector<int> escalated;
+
+	_matches.resize(n);
+
+	// classify every query with the coarse model
+	auto start = std::chrono::steady_clock::now();
+
+	Matrix P_coarse = slice_rows(X_test, 0, m);
+
+	for ( int i = 0; i < n; i++ ) {
+		auto ranking = _coarse.rank(P_coarse, i, std::max(_shortlist, 2), std::vector<bool>());
+
+		_matches[i] = ranking_match(ranking);
+
+		// escalate ambiguous queries with the shortlist of closest classes
+		if ( relative_margin(ranking) < _margin ) {
+			std::vector<bool> shortlist(_num_classes, false);
+
+			for ( int s = 0; s < std::min(_shortlist, (int) ranking.size()); s++ ) {
+				shortlist[ranking[s].second] = true;
+			}
+
+			shortlists.push_back(shortlist);
+			escalated.push_back(i);
+		}
+	}
+
+	auto mid = std::chrono::steady_clock::now();
+
+	// re-score escalated queries with the fine model
+	if ( !escalated.empty() ) {
+		Matrix X_escalated(X_test.rows() - m, escalated.size());
+
+		for ( size_t e = 0; e < escalated.size(); e++ ) {
+			for ( int k = 0; k < X_escalated.rows(); k++ ) {
+				X_escalated.elem(k, e) = X_test.elem(m + k, escalated[e]);
+			}
+		}
+
+		Matrix P_escalated = _feature->project_fine(X_escalated);
+
+		for ( size_t e = 0; e < escalated.size(); e++ ) {
+			_matches[escalated[e]] = ranking_match(_fine.rank(P_escalated, e, 2, shortlists[e]));
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	for ( int i = 0; i < n; i++ ) {
+		y_pred[i] = _matches[i].y;
+	}
+
+	_num_queries += n;
+	_num_escalated += escalated.size();
+	_coarse_time += std::chrono::duration<float>(mid - start).count();
+	_fine_time += std::chrono::duration<float>(end - mid).count();
+
+	return y_pred;
+}
+
+
+
+/**
+ * Print information about a cascade layer.
+ */
+void CascadeLayer::print()
+{
+	log(LogLevel::Verbose, "Cascade");
+	log(LogLevel::Verbose, "  %-20s  %10f", "margin", _margin);
+	log(LogLevel::Verbose, "  %-20s  %10d", "shortlist", _shortlist);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print cascade statistics. The speedup is estimated by
+ * comparing the actual cost with the cost of running the
+ * fine stage, as measured on the escalated queries, on
+ * every query. The coarse projection is performed by the
+ * feature layer of the model, so it is not included.
+ */
+void CascadeLayer::print_stats()
+{
+	if ( _num_queries == 0 ) {
+		return;
+	}
+
+	float coarse_per_query = _coarse_time / _num_queries;
+	float fine_per_query = (_num_escalated > 0) ? _fine_time / _num_escalated : 0;
+	float total_time = _coarse_time + _fine_time;
+
+	log(LogLevel::Info, "cascade: %ld queries, %ld escalated (%.1f%%)",
+		_num_queries,
+		_num_escalated,
+		100.0f * _num_escalated / _num_queries);
+	log(LogLevel::Info, "cascade: coarse %.3f ms per query, fine %.3f ms per escalated query",
+		1000 * coarse_per_query,
+		1000 * fine_per_query);
+
+	if ( _num_escalated > 0 && total_time > 0 ) {
+		log(LogLevel::Info, "cascade: %.3f s total, estimated %.2fx speedup over the fine model alone",
+			total_time,
+			fine_per_query * _num_queries / total_time);
+	}
+}
@@ -0,0 +1,70 @@
+/**
+ * @file cascadelayer.h
+ *
+ * Interface definitions for the coarse-to-fine cascade layers.
+ */
+#ifndef CASCADELAYER_H
+#define CASCADELAYER_H
+
+#include <fstream>
+#include <memory>
+#include <mlearn.h>
+#include <vector>
+#include "gallerylayer.h"
+#include "matchlayer.h"
+
+
+
+class CascadeFeatureLayer : public ML::FeatureLayer {
+private:
+	std::unique_ptr<ML::FeatureLayer> _coarse;
+	std::unique_ptr<ML::FeatureLayer> _fine;
+	int _num_dims;
+
+public:
+	CascadeFeatureLayer(ML::FeatureLayer *coarse, ML::FeatureLayer *fine);
+	~CascadeFeatureLayer() {};
+
+	int num_dims() const { return _num_dims; }
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+	ML::Matrix project_fine(const ML::Matrix& X);
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+
+	void print();
+};
+
+
+
+class CascadeLayer : public MatchLayer {
+private:
+	CascadeFeatureLayer *_feature;
+	float _margin;
+	int _shortlist;
+
+	GalleryLayer _coarse;
+	GalleryLayer _fine;
+	int _num_classes;
+
+	long _num_queries;
+	long _num_escalated;
+	float _coarse_time;
+	float _fine_time;
+
+public:
+	CascadeLayer(CascadeFeatureLayer *feature, MatchDist dist, float margin, int shortlist, int chunk, int block);
+	~CascadeLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	std::vector<int> predict(const ML::Matrix& X_test);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * @file checkpoint.cpp
+ *
+ * Implementation of the asynchronous checkpoint writer.
+ *
+ * Checkpoints are written by a background thread, so that the
+ * training loop only pays for taking a snapshot of its state.
+ * If a new checkpoint is submitted while the previous one is
+ * still being written, the older pending snapshot is replaced,
+ * since only the latest state is worth keeping. Each checkpoint
+ * is written to a temporary file which is then renamed over the
+ * previous checkpoint, so an interrupted write never corrupts
+ * the last complete checkpoint.
+ */
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mlearn.h>
+#include "checkpoint.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a checkpoint writer.
+ *
+ * @param path
+ */
+CheckpointWriter::CheckpointWriter(const std::string& path)
+{
+	_path = path;
+	_busy = false;
+	_done = false;
+
+	_num_submitted = 0;
+	_num_written = 0;
+	_write_time = 0;
+
+	_thread = std::thread(&CheckpointWriter::run, this);
+}
+
+
+
+/**
+ * Destruct a checkpoint writer. Any pending checkpoint
+ * is written before the thread exits.
+ */
+CheckpointWriter::~CheckpointWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_done = true;
+	}
+
+	_cond.notify_all();
+	_thread.join();
+}
+
+
+
+/**
+ * Write checkpoints as they are submitted.
+ */
+void CheckpointWriter::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while ( true ) {
+		_cond.wait(lock, [this] { return _pending || _done; });
+
+		if ( !_pending ) {
+			break;
+		}
+
+		checkpoint_func_t func;
+
+		std::swap(func, _pending);
+		_busy = true;
+
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		bool success = write(func);
+		auto end = std::chrono::steady_clock::now();
+
+		lock.lock();
+
+		if ( success ) {
+			_num_written++;
+			_write_time += std::chrono::duration<float>(end - start).count();
+		}
+
+		_busy = false;
+		_cond.notify_all();
+	}
+}
+
+
+
+/**
+ * Write a checkpoint to a temporary file and move it
+ * into place. Returns false if the checkpoint could not
+ * be written.
+ *
+ * @param func
+ */
+bool CheckpointWriter::write(const checkpoint_func_t& func)
+{
+	std::string tmp_path = _path + ".tmp";
+	std::ofstream file(tmp_path, std::ofstream::out | std::ofstream::binary);
+
+	func(file);
+	file.close();
+
+	if ( !file || rename(tmp_path.c_str(), _path.c_str()) != 0 ) {
+		std::cerr << "warning: could not write checkpoint " << _path << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * Submit a checkpoint to be written in the background. The
+ * function should capture a copy of the state to be saved.
+ *
+ * @param func
+ */
+void CheckpointWriter::submit(checkpoint_func_t func)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending = std::move(func);
+		_num_submitted++;
+	}
+
+	_cond.notify_all();
+}
+
+
+
+/**
+ * Wait until all submitted checkpoints have been written.
+ */
+void CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	_cond.wait(lock, [this] { return !_pending && !_busy; });
+}
+
+
+
+/**
+ * Print checkpoint statistics.
+ */
+void CheckpointWriter::print_stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if ( _num_submitted == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "checkpoint: %d submitted, %d written, %.3f ms per write",
+		_num_submitted,
+		_num_written,
+		(_num_written > 0) ? 1000 * _write_time / _num_written : 0.0f);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file checkpoint.h
+ *
+ * Interface definitions for the asynchronous checkpoint writer.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+
+typedef std::function<void(std::ofstream&)> checkpoint_func_t;
+
+
+
+class CheckpointWriter {
+private:
+	std::string _path;
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	checkpoint_func_t _pending;
+	bool _busy;
+	bool _done;
+
+	int _num_submitted;
+	int _num_written;
+	float _write_time;
+
+	void run();
+	bool write(const checkpoint_func_t& func);
+
+public:
+	CheckpointWriter(const std::string& path);
+	~CheckpointWriter();
+
+	const std::string& path() const { return _path; }
+
+	void submit(checkpoint_func_t func);
+	void flush();
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,652 @@
+/**
+ * @file checkpointicalayer.cpp
+ *
+ * Implementation of the checkpointed ICA feature layer.
+ *
+ * The layer computes independent components with the same two-stage
+ * approach as the ICA layer: samples are projected into a PCA subspace
+ * and whitened, and the unmixing matrix is then estimated with the
+ * symmetric FastICA fixed-point iteration. The PCA basis, whitening
+ * transform and unmixing matrix are checkpointed periodically during
+ * the iteration, so that a preempted training run can be resumed from
+ * the last checkpoint instead of from scratch.
+ *
+ * Each checkpoint starts with a header which identifies its training
+ * run by the hyperparameters, the dimensions of the training set and
+ * a hash of the training set, and a checkpoint from another run is
+ * rejected. The checkpoint is removed once the layer has been fitted.
+ */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include "cachedfeaturelayer.h"
+#include "checkpointicalayer.h"
+#include "linalg.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Save a checkpoint header to a file.
+ *
+ * @param file
+ * @param header
+ */
+void save_header(std::ofstream& file, const ICAHeader& header)
+{
+	int key_size = header.key.size();
+
+	file.write(reinterpret_cast<const char *>(&key_size), sizeof(int));
+	file.write(header.key.data(), key_size);
+	file.write(reinterpret_cast<const char *>(&header.rows), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&header.cols), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&header.hash), sizeof(uint64_t));
+}
+
+
+
+/**
+ * Load a checkpoint header from a file. Returns false if
+ * the header could not be read.
+ *
+ * @param file
+ * @param header
+ */
+bool load_header(std::ifstream& file, ICAHeader& header)
+{
+	const int MAX_KEY_SIZE = 256;
+	int key_size;
+
+	file.read(reinterpret_cast<char *>(&key_size), sizeof(int));
+
+	if ( !file || key_size < 0 || key_size > MAX_KEY_SIZE ) {
+		return false;
+	}
+
+	header.key.resize(key_size);
+
+	file.read(&header.key[0], key_size);
+	file.read(reinterpret_cast<char *>(&header.rows), sizeof(int));
+	file.read(reinterpret_cast<char *>(&header.cols), sizeof(int));
+	file.read(reinterpret_cast<char *>(&header.hash), sizeof(uint64_t));
+
+	return (bool) file;
+}
+
+
+
+/**
+ * Save an ICA state to a file.
+ *
+ * @param file
+ * @param state
+ */
+void save_state(std::ofstream& file, const ICAState& state)
+{
+	int n1 = state.scale.size();
+	int n2 = state.W.size() / n1;
+
+	file.write(reinterpret_cast<const char *>(&state.iter), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&n1), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&n2), sizeof(int));
+
+	state.pca->save(file);
+
+	file.write(reinterpret_cast<const char *>(state.mu.data()), state.mu.size() * sizeof(float));
+	file.write(reinterpret_cast<const char *>(state.scale.data()), state.scale.size() * sizeof(float));
+	file.write(reinterpret_cast<const char *>(state.W.data()), state.W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Load an ICA state from a file.
+ *
+ * @param file
+ * @param state
+ * @param solver
+ * @param energy
+ */
+void load_state(std::ifstream& file, ICAState& state, EigenSolver solver, float energy)
+{
+	int n1;
+	int n2;
+
+	file.read(reinterpret_cast<char *>(&state.iter), sizeof(int));
+	file.read(reinterpret_cast<char *>(&n1), sizeof(int));
+	file.read(reinterpret_cast<char *>(&n2), sizeof(int));
+
+	state.pca.reset(create_pca(solver, n1, energy));
+	state.pca->load(file);
+
+	state.mu.resize(n1);
+	state.scale.resize(n1);
+	state.W.resize((size_t) n2 * n1);
+
+	file.read(reinterpret_cast<char *>(state.mu.data()), state.mu.size() * sizeof(float));
+	file.read(reinterpret_cast<char *>(state.scale.data()), state.scale.size() * sizeof(float));
+	file.read(reinterpret_cast<char *>(state.W.data()), state.W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Evaluate a nonlinearity function g and its derivative g'.
+ *
+ * @param nonl
+ * @param u
+ * @param dg
+ */
+inline float nonl_eval(ICANonl nonl, float u, float& dg)
+{
+	if ( nonl == ICANonl::pow3 ) {
+		dg = 3 * u * u;
+		return u * u * u;
+	}
+	else if ( nonl == ICANonl::tanh ) {
+		float t = tanhf(u);
+
+		dg = 1 - t * t;
+		return t;
+	}
+	else {
+		float e = expf(-u * u / 2);
+
+		dg = (1 - u * u) * e;
+		return u * e;
+	}
+}
+
+
+
+/**
+ * Construct a checkpointed ICA layer.
+ *
+ * @param n1
+ * @param n2
+ * @param nonl
+ * @param max_iter
+ * @param eps
+ * @param interval
+ * @param path
+ * @param resume
+ * @param solver
+ * @param energy
+ */
+CheckpointICALayer::CheckpointICALayer(int n1, int n2, ICANonl nonl, int max_iter, float eps, int interval, const std::string& path, bool resume, EigenSolver solver, float energy)
+{
+	_n1 = n1;
+	_n2 = n2;
+	_nonl = nonl;
+	_max_iter = max_iter;
+	_eps = eps;
+	_interval = interval;
+	_path = path;
+	_resume = resume;
+	_solver = solver;
+	_energy = energy;
+
+	_state.iter = 0;
+
+	// the stopping criteria are not part of the key, so that a
+	// run can be resumed with more iterations
+	char key[128];
+
+	snprintf(key, sizeof(key), "ica n1=%d n2=%d nonl=%d energy=%g solver=%d", n1, n2, (int) nonl, energy, (int) solver);
+
+	_header.key = key;
+	_header.rows = 0;
+	_header.cols = 0;
+	_header.hash = 0;
+
+	if ( interval > 0 ) {
+		_writer.reset(new CheckpointWriter(path));
+	}
+
+	_snapshot_time = 0;
+}
+
+
+
+/**
+ * Whiten a matrix of PCA projections. The result is stored
+ * with one row per sample.
+ *
+ * @param P
+ * @param Z
+ */
+void CheckpointICALayer::whiten(const Matrix& P, std::vector<float>& Z) const
+{
+	int n1 = P.rows();
+	int n = P.cols();
+
+	Z.resize((size_t) n * n1);
+
+	for ( int i = 0; i < n; i++ ) {
+		for ( int j = 0; j < n1; j++ ) {
+			Z[(size_t) i * n1 + j] = (P.elem(j, i) - _state.mu[j]) * _state.scale[j];
+		}
+	}
+}
+
+
+
+/**
+ * Decorrelate the rows of an unmixing matrix in place:
+ *
+ *   W = (W * W')^(-1/2) * W
+ *
+ * @param W
+ */
+void CheckpointICALayer::decorrelate(std::vector<double>& W) const
+{
+	int n1 = _state.scale.size();
+	int n2 = W.size() / n1;
+
+	// compute M = W * W'
+	std::vector<double> M((size_t) n2 * n2);
+
+	for ( int p = 0; p < n2; p++ ) {
+		for ( int q = 0; q <= p; q++ ) {
+			double sum = 0;
+
+			for ( int j = 0; j < n1; j++ ) {
+				sum += W[(size_t) p * n1 + j] * W[(size_t) q * n1 + j];
+			}
+
+			M[(size_t) p * n2 + q] = M[(size_t) q * n2 + p] = sum;
+		}
+	}
+
+	// compute K = M^(-1/2) = E * D^(-1/2) * E'
+	std::vector<double> evals;
+
+	sym_eigen(M, n2, evals);
+
+	std::vector<double> K((size_t) n2 * n2, 0.0);
+
+	for ( int k = 0; k < n2; k++ ) {
+		double d = 1 / sqrt(std::max(evals[k], 1e-12));
+
+		for ( int p = 0; p < n2; p++ ) {
+			for ( int q = 0; q < n2; q++ ) {
+				K[(size_t) p * n2 + q] += M[(size_t) p * n2 + k] * d * M[(size_t) q * n2 + k];
+			}
+		}
+	}
+
+	// compute W = K * W
+	std::vector<double> W_old(W);
+
+	for ( int p = 0; p < n2; p++ ) {
+		for ( int j = 0; j < n1; j++ ) {
+			double sum = 0;
+
+			for ( int q = 0; q < n2; q++ ) {
+				sum += K[(size_t) p * n2 + q] * W_old[(size_t) q * n1 + j];
+			}
+
+			W[(size_t) p * n1 + j] = sum;
+		}
+	}
+}
+
+
+
+/**
+ * Perform one fixed-point iteration on the whitened samples:
+ *
+ *   w_p = E[z * g(w_p' * z)] - E[g'(w_p' * z)] * w_p
+ *
+ * followed by symmetric decorrelation. Returns the largest change
+ * in direction of any row of the unmixing matrix.
+ *
+ * @param Z
+ * @param n
+ */
+float CheckpointICALayer::update(const std::vector<float>& Z, int n)
+{
+	int n1 = _state.scale.size();
+	int n2 = _state.W.size() / n1;
+	const std::vector<float>& W = _state.W;
+
+	std::vector<double> W_new((size_t) n2 * n1, 0.0);
+	std::vector<double> dg_sum(n2, 0.0);
+
+	for ( int i = 0; i < n; i++ ) {
+		const float *z = &Z[(size_t) i * n1];
+
+		for ( int p = 0; p < n2; p++ ) {
+			const float *w_p = &W[(size_t) p * n1];
+			double *w_new = &W_new[(size_t) p * n1];
+			float u = 0;
+
+			for ( int j = 0; j < n1; j++ ) {
+				u += w_p[j] * z[j];
+			}
+
+			float dg;
+			float g = nonl_eval(_nonl, u, dg);
+
+			for ( int j = 0; j < n1; j++ ) {
+				w_new[j] += g * z[j];
+			}
+
+			dg_sum[p] += dg;
+		}
+	}
+
+	for ( int p = 0; p < n2; p++ ) {
+		for ( int j = 0; j < n1; j++ ) {
+			W_new[(size_t) p * n1 + j] = (W_new[(size_t) p * n1 + j] - dg_sum[p] * W[(size_t) p * n1 + j]) / n;
+		}
+	}
+
+	decorrelate(W_new);
+
+	// compute the change in direction of each row
+	float delta = 0;
+
+	for ( int p = 0; p < n2; p++ ) {
+		double dot = 0;
+
+		for ( int j = 0; j < n1; j++ ) {
+			dot += W_new[(size_t) p * n1 + j] * W[(size_t) p * n1 + j];
+		}
+
+		delta = std::max(delta, (float) (1 - fabs(dot)));
+	}
+
+	_state.W.assign(W_new.begin(), W_new.end());
+
+	return delta;
+}
+
+
+
+/**
+ * Submit a snapshot of the current state to the checkpoint writer.
+ * Only the copy is done on the training thread; the snapshot is
+ * written in the background.
+ */
+void CheckpointICALayer::checkpoint()
+{
+	if ( !_writer ) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	ICAHeader header = _header;
+	ICAState snapshot = _state;
+
+	_writer->submit([header, snapshot] (std::ofstream& file) {
+		save_header(file, header);
+		save_state(file, snapshot);
+	});
+
+	auto end = std::chrono::steady_clock::now();
+
+	_snapshot_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Restore the state from the checkpoint file. Returns false
+ * if there is no checkpoint to resume from. A checkpoint
+ * whose header does not match the current training run is
+ * rejected.
+ *
+ * @param header
+ */
+bool CheckpointICALayer::restore(const ICAHeader& header)
+{
+	std::ifstream file(_path, std::ifstream::in | std::ifstream::binary);
+
+	if ( !file.is_open() ) {
+		std::cerr << "warning: no checkpoint found at " << _path << ", starting from scratch\n";
+		return false;
+	}
+
+	ICAHeader saved;
+
+	if ( !load_header(file, saved) ) {
+		std::cerr << "error: could not read checkpoint " << _path << "\n";
+		exit(1);
+	}
+
+	if ( saved.key != header.key ) {
+		std::cerr << "error: checkpoint " << _path << " was written with different hyperparameters (" << saved.key << ")\n";
+		exit(1);
+	}
+
+	if ( saved.rows != header.rows || saved.cols != header.cols ) {
+		std::cerr << "error: checkpoint " << _path << " was written for a " << saved.rows << " x " << saved.cols << " training set\n";
+		exit(1);
+	}
+
+	if ( saved.hash != header.hash ) {
+		std::cerr << "error: checkpoint " << _path << " was written for a different training set\n";
+		exit(1);
+	}
+
+	load_state(file, _state, _solver, _energy);
+
+	log(LogLevel::Verbose, "resuming ICA from %s at iteration %d", _path.c_str(), _state.iter);
+
+	return true;
+}
+
+
+
+/**
+ * Compute the independent components of a training set.
+ *
+ * If resuming from a checkpoint, the PCA basis, whitening
+ * transform and unmixing matrix are restored and the iteration
+ * continues where it left off. Otherwise the PCA basis is
+ * computed and checkpointed before the first iteration. The
+ * checkpoint is removed once the iteration has finished.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void CheckpointICALayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	int n = X.cols();
+
+	// identify the training run of the checkpoints
+	if ( _writer || _resume ) {
+		_header.rows = X.rows();
+		_header.cols = X.cols();
+		_header.hash = hash_training_set(_header.key, X, y, c);
+	}
+
+	if ( !_resume || !restore(_header) ) {
+		_state.pca.reset(create_pca(_solver, _n1, _energy));
+		_state.pca->compute(X, y, c);
+
+		Matrix P = _state.pca->project(X);
+		int n1 = P.rows();
+		int n2 = (_n2 > 0) ? std::min(_n2, n1) : n1;
+
+		// compute whitening transform
+		_state.mu.assign(n1, 0.0f);
+		_state.scale.assign(n1, 0.0f);
+
+		for ( int j = 0; j < n1; j++ ) {
+			double mean = 0;
+			double var = 0;
+
+			for ( int i = 0; i < n; i++ ) {
+				mean += P.elem(j, i);
+			}
+			mean /= n;
+
+			for ( int i = 0; i < n; i++ ) {
+				double t = P.elem(j, i) - mean;
+				var += t * t;
+			}
+			var /= n;
+
+			_state.mu[j] = mean;
+			_state.scale[j] = (var > 0) ? 1 / sqrt(var) : 0;
+		}
+
+		// initialize unmixing matrix
+		std::vector<double> W((size_t) n2 * n1);
+
+		for ( double& w : W ) {
+			w = Random::normal();
+		}
+
+		decorrelate(W);
+
+		_state.W.assign(W.begin(), W.end());
+		_state.iter = 0;
+
+		checkpoint();
+	}
+
+	std::vector<float> Z;
+
+	whiten(_state.pca->project(X), Z);
+
+	// perform fixed-point iteration
+	while ( _state.iter < _max_iter ) {
+		float delta = update(Z, n);
+
+		_state.iter++;
+
+		log(LogLevel::Debug, "iteration %d: delta = %g", _state.iter, delta);
+
+		if ( delta < _eps ) {
+			break;
+		}
+
+		if ( _interval > 0 && _state.iter % _interval == 0 ) {
+			checkpoint();
+		}
+	}
+
+	log(LogLevel::Verbose, "ICA finished after %d iterations", _state.iter);
+
+	// wait for pending checkpoints, and remove the checkpoint
+	// since there is nothing left to resume
+	if ( _writer ) {
+		_writer->flush();
+	}
+
+	if ( _writer || _resume ) {
+		remove(_path.c_str());
+	}
+}
+
+
+
+/**
+ * Project a matrix onto the independent components.
+ *
+ * @param X
+ */
+Matrix CheckpointICALayer::project(const Matrix& X)
+{
+	std::vector<float> Z;
+
+	whiten(_state.pca->project(X), Z);
+
+	int n1 = _state.scale.size();
+	int n2 = _state.W.size() / n1;
+	Matrix S(n2, X.cols());
+
+	for ( int i = 0; i < X.cols(); i++ ) {
+		const float *z = &Z[(size_t) i * n1];
+
+		for ( int p = 0; p < n2; p++ ) {
+			const float *w_p = &_state.W[(size_t) p * n1];
+			float sum = 0;
+
+			for ( int j = 0; j < n1; j++ ) {
+				sum += w_p[j] * z[j];
+			}
+
+			S.elem(p, i) = sum;
+		}
+	}
+
+	return S;
+}
+
+
+
+/**
+ * Save a checkpointed ICA layer to a file.
+ *
+ * @param file
+ */
+void CheckpointICALayer::save(std::ofstream& file)
+{
+	save_state(file, _state);
+}
+
+
+
+/**
+ * Load a checkpointed ICA layer from a file.
+ *
+ * @param file
+ */
+void CheckpointICALayer::load(std::ifstream& file)
+{
+	load_state(file, _state, _solver, _energy);
+}
+
+
+
+/**
+ * Print information about a checkpointed ICA layer.
+ */
+void CheckpointICALayer::print()
+{
+	log(LogLevel::Verbose, "ICA (checkpointed)");
+	log(LogLevel::Verbose, "  %-20s  %10d", "n1", _n1);
+	log(LogLevel::Verbose, "  %-20s  %10d", "n2", _n2);
+	log(LogLevel::Verbose, "  %-20s  %10d", "max_iter", _max_iter);
+	log(LogLevel::Verbose, "  %-20s  %10f", "eps", _eps);
+	log(LogLevel::Verbose, "  %-20s  %10d", "checkpoint", _interval);
+	log(LogLevel::Verbose, "  %-20s  %10f", "energy", _energy);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print the statistics of the PCA stage and of the
+ * checkpoints. The snapshot time is the time
+ * spent on the training thread, while the write time is spent
+ * in the background.
+ */
+void CheckpointICALayer::print_stats()
+{
+	LanczosPCALayer *pca = dynamic_cast<LanczosPCALayer *>(_state.pca.get());
+
+	if ( pca != nullptr ) {
+		pca->print_stats();
+	}
+
+	if ( !_writer ) {
+		return;
+	}
+
+	log(LogLevel::Info, "ica: %d iterations, %.3f ms on snapshots", _state.iter, 1000 * _snapshot_time);
+
+	_writer->print_stats();
+}
@@ -0,0 +1,80 @@
+/**
+ * @file checkpointicalayer.h
+ *
+ * Interface definitions for the checkpointed ICA feature layer.
+ */
+#ifndef CHECKPOINTICALAYER_H
+#define CHECKPOINTICALAYER_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mlearn.h>
+#include <string>
+#include <vector>
+#include "checkpoint.h"
+#include "lanczospcalayer.h"
+
+
+
+typedef struct {
+	int iter;
+	std::shared_ptr<ML::FeatureLayer> pca;
+	std::vector<float> mu;
+	std::vector<float> scale;
+	std::vector<float> W;
+} ICAState;
+
+
+
+typedef struct {
+	std::string key;
+	int rows;
+	int cols;
+	uint64_t hash;
+} ICAHeader;
+
+
+
+class CheckpointICALayer : public ML::FeatureLayer {
+private:
+	int _n1;
+	int _n2;
+	ML::ICANonl _nonl;
+	int _max_iter;
+	float _eps;
+	int _interval;
+	std::string _path;
+	bool _resume;
+	EigenSolver _solver;
+	float _energy;
+
+	ICAState _state;
+	ICAHeader _header;
+
+	std::unique_ptr<CheckpointWriter> _writer;
+	float _snapshot_time;
+
+	void whiten(const ML::Matrix& P, std::vector<float>& Z) const;
+	void decorrelate(std::vector<double>& W) const;
+	float update(const std::vector<float>& Z, int n);
+	void checkpoint();
+	bool restore(const ICAHeader& header);
+
+public:
+	CheckpointICALayer(int n1, int n2, ML::ICANonl nonl, int max_iter, float eps, int interval, const std::string& path, bool resume, EigenSolver solver, float energy);
+	~CheckpointICALayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
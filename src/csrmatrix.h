@@ -0,0 +1,28 @@
+/**
+ * @file csrmatrix.h
+ *
+ * Definition of a read-only view of a sparse matrix in CSR format.
+ */
+#ifndef CSRMATRIX_H
+#define CSRMATRIX_H
+
+#include <cstdint>
+
+
+
+/**
+ * Sparse matrix with one row per sample. The row pointers index
+ * the column and value arrays directly, so a view of a range of
+ * rows shares the arrays of the whole matrix.
+ */
+typedef struct {
+	int rows;
+	int cols;
+	const int64_t *row_ptr;
+	const int32_t *col_idx;
+	const float *values;
+} csr_matrix_t;
+
+
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file detectionlog.cpp
+ *
+ * Implementation of the detection log.
+ *
+ * The log records the faces detected in each frame of a video
+ * stream, so that the classification stage can be benchmarked
+ * repeatedly on identical input without running the cascade. The
+ * file consists of a short header followed by one record per frame:
+ * the frame index, the number of faces, the bounding box of each
+ * face, and optionally the face crops, resized to the classifier
+ * input size and stored as raw BGR pixels. With crops, a replay
+ * does not need the original video at all.
+ */
+#include <cstring>
+#include <iostream>
+#include <mlearn.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "detectionlog.h"
+
+
+
+using namespace ML;
+
+
+
+typedef struct {
+	char magic[4];
+	int32_t version;
+	int32_t crops;
+	int32_t width;
+	int32_t height;
+} detection_header_t;
+
+
+
+/**
+ * Construct a detection log writer.
+ *
+ * @param path
+ * @param crops
+ * @param size
+ */
+DetectionWriter::DetectionWriter(const std::string& path, bool crops, cv::Size size)
+{
+	_file.open(path, std::ofstream::binary);
+	_crops = crops;
+	_size = size;
+
+	_num_frames = 0;
+	_num_faces = 0;
+
+	if ( !_file.is_open() ) {
+		std::cerr << "error: could not open " << path << "\n";
+		exit(1);
+	}
+
+	detection_header_t header = { { 'D', 'L', 'O', 'G' }, 1, crops, size.width, size.height };
+
+	_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+
+
+/**
+ * Write the faces of a frame to the log.
+ *
+ * @param frame
+ * @param image
+ * @param rects
+ */
+void DetectionWriter::write(int frame, const cv::Mat& image, const std::vector<cv::Rect>& rects)
+{
+	int32_t values[] = { frame, (int32_t) rects.size() };
+
+	_file.write(reinterpret_cast<const char *>(values), sizeof(values));
+
+	for ( auto& rect : rects ) {
+		int32_t r[] = { rect.x, rect.y, rect.width, rect.height };
+
+		_file.write(reinterpret_cast<const char *>(r), sizeof(r));
+	}
+
+	if ( _crops ) {
+		for ( auto& rect : rects ) {
+			cv::Mat face;
+
+			cv::resize(image(rect), face, _size);
+
+			_file.write(reinterpret_cast<const char *>(face.data), face.total() * face.elemSize());
+		}
+	}
+
+	_num_frames++;
+	_num_faces += rects.size();
+}
+
+
+
+/**
+ * Print recording statistics.
+ */
+void DetectionWriter::print_stats()
+{
+	log(LogLevel::Info, "record: %d frames, %ld faces, %.2f MB",
+		_num_frames,
+		_num_faces,
+		(float) _file.tellp() / 1e6);
+}
+
+
+
+/**
+ * Construct a detection log reader.
+ *
+ * @param path
+ */
+DetectionReader::DetectionReader(const std::string& path)
+{
+	_file.open(path, std::ifstream::binary);
+
+	detection_header_t header;
+
+	memset(&header, 0, sizeof(header));
+	_file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+	if ( !_file.good() || memcmp(header.magic, "DLOG", 4) != 0 || header.version != 1 ) {
+		std::cerr << "error: " << path << " is not a detection log\n";
+		exit(1);
+	}
+
+	_crops = header.crops;
+	_size = cv::Size(header.width, header.height);
+}
+
+
+
+/**
+ * Read the next frame from the log. Returns false at the
+ * end of the log.
+ *
+ * @param record
+ */
+bool DetectionReader::read(detection_record_t& record)
+{
+	int32_t values[2];
+
+	if ( !_file.read(reinterpret_cast<char *>(values), sizeof(values)) ) {
+		return false;
+	}
+
+	record.frame = values[0];
+	record.rects.resize(values[1]);
+	record.faces.clear();
+
+	for ( auto& rect : record.rects ) {
+		int32_t r[4];
+
+		_file.read(reinterpret_cast<char *>(r), sizeof(r));
+		rect = cv::Rect(r[0], r[1], r[2], r[3]);
+	}
+
+	if ( _crops ) {
+		for ( size_t i = 0; i < record.rects.size(); i++ ) {
+			cv::Mat face(_size, CV_8UC3);
+
+			_file.read(reinterpret_cast<char *>(face.data), face.total() * face.elemSize());
+			record.faces.push_back(face);
+		}
+	}
+
+	return _file.good();
+}
@@ -0,0 +1,60 @@
+/**
+ * @file detectionlog.h
+ *
+ * Interface definitions for the detection log, which records
+ * the detected faces of a video stream for replay.
+ */
+#ifndef DETECTIONLOG_H
+#define DETECTIONLOG_H
+
+#include <fstream>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+
+
+typedef struct {
+	int frame;
+	std::vector<cv::Rect> rects;
+	std::vector<cv::Mat> faces;
+} detection_record_t;
+
+
+
+class DetectionWriter {
+private:
+	std::ofstream _file;
+	bool _crops;
+	cv::Size _size;
+
+	int _num_frames;
+	long _num_faces;
+
+public:
+	DetectionWriter(const std::string& path, bool crops, cv::Size size);
+
+	void write(int frame, const cv::Mat& image, const std::vector<cv::Rect>& rects);
+
+	void print_stats();
+};
+
+
+
+class DetectionReader {
+private:
+	std::ifstream _file;
+	bool _crops;
+	cv::Size _size;
+
+public:
+	DetectionReader(const std::string& path);
+
+	bool crops() const { return _crops; }
+
+	bool read(detection_record_t& record);
+};
+
+
+
+#endif
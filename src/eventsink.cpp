@@ -0,0 +1,348 @@
+/**
+ * @file eventsink.cpp
+ *
+ * Implementation of the recognition event sink.
+ *
+ * The sink delivers recognition events to downstream systems as JSON
+ * lines, written to a file, a named pipe, or a Unix socket. The
+ * recognition thread must never wait on the output, so events are
+ * passed through a single-producer, single-consumer ring buffer which
+ * needs no locks: the producer only advances the tail and the consumer
+ * only advances the head. If the ring is full the event is dropped and
+ * counted. A writer thread drains the ring periodically and writes all
+ * pending events with a single system call.
+ *
+ * SIGPIPE is blocked on the writer thread, so that a reader which
+ * goes away makes the write fail with EPIPE and disables the output
+ * instead of terminating the program. A named pipe is opened without
+ * blocking, and the open is retried until a reader appears or the
+ * sink is closed.
+ */
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mlearn.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "eventsink.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Escape a string for a JSON string literal.
+ *
+ * @param str
+ */
+std::string json_escape(const std::string& str)
+{
+	std::string result;
+
+	for ( char c : str ) {
+		if ( c == '"' || c == '\\' ) {
+			result += '\\';
+			result += c;
+		}
+		else if ( (unsigned char) c < 0x20 ) {
+			result += ' ';
+		}
+		else {
+			result += c;
+		}
+	}
+
+	return result;
+}
+
+
+
+/**
+ * Construct an event sink. A path of the form "unix:PATH" refers
+ * to a Unix socket; any other path is opened as a file, which may
+ * be a named pipe. The capacity of the ring is rounded up to a
+ * power of two.
+ *
+ * @param path
+ * @param camera
+ * @param capacity
+ */
+EventSink::EventSink(const std::string& path, const std::string& camera, int capacity)
+{
+	size_t size = 1;
+
+	while ( size < (size_t) capacity ) {
+		size *= 2;
+	}
+
+	_path = path;
+	_camera = json_escape(camera);
+	_fd = -1;
+	_socket = false;
+	_done = false;
+
+	_ring.resize(size);
+	_mask = size - 1;
+	_head = 0;
+	_tail = 0;
+
+	_num_pushed = 0;
+	_num_dropped = 0;
+	_num_written = 0;
+	_num_batches = 0;
+	_num_bytes = 0;
+	_write_time = 0;
+	_run_time = 0;
+
+	_thread = std::thread(&EventSink::run, this);
+}
+
+
+
+/**
+ * Destruct an event sink.
+ */
+EventSink::~EventSink()
+{
+	close();
+}
+
+
+
+/**
+ * Open the output. Returns false with errno set to ENXIO if
+ * the output is a named pipe which has no reader yet, in which
+ * case the open should be retried.
+ */
+bool EventSink::open_output()
+{
+	const std::string SOCKET_PREFIX = "unix:";
+
+	if ( _path.compare(0, SOCKET_PREFIX.size(), SOCKET_PREFIX) == 0 ) {
+		std::string address = _path.substr(SOCKET_PREFIX.size());
+		struct sockaddr_un addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+
+		_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		_socket = true;
+
+		if ( _fd != -1 && connect(_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+	else {
+		_fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
+
+		if ( _fd == -1 && errno == ENXIO ) {
+			return false;
+		}
+
+		// writes may block, since only the writer thread waits on them
+		if ( _fd != -1 ) {
+			fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_NONBLOCK);
+		}
+	}
+
+	if ( _fd == -1 ) {
+		std::cerr << "warning: could not open event output " << _path << ", events will be discarded\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * Write all pending events in one batch. Returns the number
+ * of events which were taken from the ring.
+ */
+size_t EventSink::flush()
+{
+	size_t head = _head.load(std::memory_order_relaxed);
+	size_t tail = _tail.load(std::memory_order_acquire);
+
+	if ( head == tail ) {
+		return 0;
+	}
+
+	// format pending events and release their slots
+	std::ostringstream batch;
+
+	batch.precision(3);
+	batch << std::fixed;
+
+	for ( size_t i = head; i < tail; i++ ) {
+		const event_t& event = _ring[i & _mask];
+
+		batch
+			<< "{\"time\":" << event.timestamp
+			<< ",\"camera\":\"" << _camera << "\""
+			<< ",\"track\":" << event.track
+			<< ",\"x\":" << event.rect.x
+			<< ",\"y\":" << event.rect.y
+			<< ",\"width\":" << event.rect.width
+			<< ",\"height\":" << event.rect.height
+			<< ",\"label\":\"" << json_escape(event.label) << "\""
+			<< ",\"dist\":" << event.dist
+			<< "}\n";
+	}
+
+	_head.store(tail, std::memory_order_release);
+
+	if ( _fd == -1 ) {
+		return tail - head;
+	}
+
+	// write the batch, disabling the output if it fails
+	auto start = std::chrono::steady_clock::now();
+
+	std::string data = batch.str();
+	size_t offset = 0;
+
+	while ( offset < data.size() ) {
+		ssize_t n = _socket
+			? send(_fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL)
+			: write(_fd, data.data() + offset, data.size() - offset);
+
+		if ( n <= 0 ) {
+			std::cerr << "warning: could not write event output " << _path << ", events will be discarded\n";
+			::close(_fd);
+			_fd = -1;
+			return tail - head;
+		}
+
+		offset += n;
+	}
+
+	_write_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	_num_written += tail - head;
+	_num_batches++;
+	_num_bytes += data.size();
+
+	return tail - head;
+}
+
+
+
+/**
+ * Drain the ring until the sink is closed.
+ */
+void EventSink::run()
+{
+	const auto POLL_INTERVAL = std::chrono::milliseconds(5);
+
+	auto start = std::chrono::steady_clock::now();
+
+	// make a broken pipe fail with EPIPE on this thread
+	sigset_t sigpipe;
+
+	sigemptyset(&sigpipe);
+	sigaddset(&sigpipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+	// wait for a reader of a named pipe, keeping events in the ring
+	while ( !open_output() && errno == ENXIO ) {
+		if ( _done.load() ) {
+			std::cerr << "warning: event output " << _path << " has no reader, events will be discarded\n";
+			break;
+		}
+
+		std::this_thread::sleep_for(POLL_INTERVAL);
+	}
+
+	while ( true ) {
+		bool done = _done.load();
+
+		if ( flush() == 0 ) {
+			if ( done ) {
+				break;
+			}
+
+			std::this_thread::sleep_for(POLL_INTERVAL);
+		}
+	}
+
+	if ( _fd != -1 ) {
+		::close(_fd);
+		_fd = -1;
+	}
+
+	_run_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+/**
+ * Add an event to the ring without waiting. Returns false if
+ * the ring is full, in which case the event is dropped. This
+ * function must only be called from one thread.
+ *
+ * @param event
+ */
+bool EventSink::push(const event_t& event)
+{
+	size_t tail = _tail.load(std::memory_order_relaxed);
+	size_t head = _head.load(std::memory_order_acquire);
+
+	if ( tail - head > _mask ) {
+		_num_dropped++;
+		return false;
+	}
+
+	_ring[tail & _mask] = event;
+	_tail.store(tail + 1, std::memory_order_release);
+	_num_pushed++;
+
+	return true;
+}
+
+
+
+/**
+ * Write the remaining events and close the output.
+ */
+void EventSink::close()
+{
+	if ( !_thread.joinable() ) {
+		return;
+	}
+
+	_done = true;
+	_thread.join();
+}
+
+
+
+/**
+ * Print event statistics.
+ */
+void EventSink::print_stats()
+{
+	if ( _num_pushed + _num_dropped == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "events: %ld pushed, %ld dropped, %ld written in %ld batches (%.1f events per batch), %.2f MB to %s",
+		_num_pushed,
+		_num_dropped,
+		_num_written,
+		_num_batches,
+		(_num_batches > 0) ? (float) _num_written / _num_batches : 0.0f,
+		_num_bytes / 1e6,
+		_path.c_str());
+	log(LogLevel::Info, "events: %.1f events/s, %.3f ms writing",
+		(_run_time > 0) ? _num_written / _run_time : 0.0f,
+		1000 * _write_time);
+}
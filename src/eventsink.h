@@ -0,0 +1,65 @@
+/**
+ * @file eventsink.h
+ *
+ * Interface definitions for the recognition event sink.
+ */
+#ifndef EVENTSINK_H
+#define EVENTSINK_H
+
+#include <atomic>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+typedef struct {
+	double timestamp;
+	int track;
+	cv::Rect rect;
+	std::string label;
+	float dist;
+} event_t;
+
+
+
+class EventSink {
+private:
+	std::string _path;
+	std::string _camera;
+	int _fd;
+	bool _socket;
+	std::thread _thread;
+	std::atomic<bool> _done;
+
+	std::vector<event_t> _ring;
+	size_t _mask;
+	std::atomic<size_t> _head;
+	std::atomic<size_t> _tail;
+
+	long _num_pushed;
+	long _num_dropped;
+	long _num_written;
+	long _num_batches;
+	long _num_bytes;
+	float _write_time;
+	float _run_time;
+
+	void run();
+	bool open_output();
+	size_t flush();
+
+public:
+	EventSink(const std::string& path, const std::string& camera, int capacity=4096);
+	~EventSink();
+
+	bool push(const event_t& event);
+	void close();
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file facetracker.cpp
+ *
+ * Implementation of the face tracker.
+ *
+ * Faces are associated across frames by the overlap of their
+ * bounding boxes. Each track remembers how many of its crops have
+ * been classified and the quality of the best one, so that a face
+ * which stays in view is classified only from its best crops
+ * instead of on every frame. Crops below a minimum quality are
+ * never classified.
+ */
+#include <algorithm>
+#include <mlearn.h>
+#include "facetracker.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Compute the intersection-over-union of two rectangles.
+ *
+ * @param a
+ * @param b
+ */
+inline float iou(const cv::Rect& a, const cv::Rect& b)
+{
+	float intersection = (a & b).area();
+
+	return intersection / (a.area() + b.area() - intersection);
+}
+
+
+
+/**
+ * Construct a face tracker.
+ *
+ * @param min_quality
+ * @param top_k
+ */
+FaceTracker::FaceTracker(float min_quality, int top_k)
+{
+	_min_quality = min_quality;
+	_top_k = top_k;
+
+	_num_crops = 0;
+	_num_classified = 0;
+	_num_rejected = 0;
+	_num_tracks = 0;
+}
+
+
+
+/**
+ * Associate the faces of a frame with tracks. Faces which do
+ * not overlap an existing track start a new track, and tracks
+ * which have not been seen for several frames are removed.
+ * Returns the track index of each face.
+ *
+ * @param rects
+ */
+std::vector<int> FaceTracker::update(const std::vector<cv::Rect>& rects)
+{
+	const float MIN_IOU = 0.3f;
+	const int MAX_MISSED = 10;
+
+	// remove lost tracks
+	std::vector<Track> tracks;
+
+	for ( auto& track : _tracks ) {
+		if ( track.missed <= MAX_MISSED ) {
+			tracks.push_back(track);
+		}
+	}
+
+	_tracks = tracks;
+
+	// match each face to the best overlapping track
+	std::vector<bool> matched(_tracks.size(), false);
+	std::vector<int> indices;
+
+	for ( auto& rect : rects ) {
+		int best = -1;
+		float best_iou = MIN_IOU;
+
+		for ( size_t t = 0; t < _tracks.size(); t++ ) {
+			float overlap = iou(rect, _tracks[t].rect);
+
+			if ( !matched[t] && overlap > best_iou ) {
+				best = t;
+				best_iou = overlap;
+			}
+		}
+
+		if ( best == -1 ) {
+			best = _tracks.size();
+			_tracks.push_back(Track { (int) _num_tracks, rect, 0, 0, 0, "" });
+			matched.push_back(false);
+			_num_tracks++;
+		}
+
+		matched[best] = true;
+		_tracks[best].rect = rect;
+		_tracks[best].missed = 0;
+
+		indices.push_back(best);
+	}
+
+	for ( size_t t = 0; t < _tracks.size(); t++ ) {
+		if ( !matched[t] ) {
+			_tracks[t].missed++;
+		}
+	}
+
+	return indices;
+}
+
+
+
+/**
+ * Determine whether a crop of a track should be classified. A crop
+ * is classified if it meets the minimum quality and, when top-k
+ * selection is enabled, if the track has fewer than k classified
+ * crops and the crop is better than every crop classified so far.
+ *
+ * @param t
+ * @param quality
+ */
+bool FaceTracker::want(int t, float quality)
+{
+	const Track& track = _tracks[t];
+
+	_num_crops++;
+
+	if ( quality < _min_quality ) {
+		_num_rejected++;
+		return false;
+	}
+
+	if ( _top_k > 0 && (track.num_classified >= _top_k || quality <= track.best_quality) ) {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * Set the label of a track from a classified crop.
+ *
+ * @param t
+ * @param quality
+ * @param label
+ */
+void FaceTracker::set_label(int t, float quality, const std::string& label)
+{
+	Track& track = _tracks[t];
+
+	track.num_classified++;
+	track.best_quality = std::max(track.best_quality, quality);
+	track.label = label;
+
+	_num_classified++;
+}
+
+
+
+/**
+ * Print tracking statistics. The reduction is the fraction of
+ * detected crops which did not need a predict call.
+ */
+void FaceTracker::print_stats()
+{
+	if ( _num_crops == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "quality: %ld crops, %ld tracks, %ld below threshold, %ld classified (%.1f%% fewer predict calls)",
+		_num_crops,
+		_num_tracks,
+		_num_rejected,
+		_num_classified,
+		100.0f * (_num_crops - _num_classified) / _num_crops);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file facetracker.h
+ *
+ * Interface definitions for the face tracker.
+ */
+#ifndef FACETRACKER_H
+#define FACETRACKER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+
+
+typedef struct {
+	int id;
+	cv::Rect rect;
+	int missed;
+	int num_classified;
+	float best_quality;
+	std::string label;
+} Track;
+
+
+
+class FaceTracker {
+private:
+	float _min_quality;
+	int _top_k;
+
+	std::vector<Track> _tracks;
+
+	long _num_crops;
+	long _num_classified;
+	long _num_rejected;
+	long _num_tracks;
+
+public:
+	FaceTracker(float min_quality, int top_k);
+
+	std::vector<int> update(const std::vector<cv::Rect>& rects);
+	bool want(int t, float quality);
+	void set_label(int t, float quality, const std::string& label);
+	int id(int t) const { return _tracks[t].id; }
+	const std::string& label(int t) const { return _tracks[t].label; }
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file frozenfeaturelayer.cpp
+ *
+ * Implementation of the frozen feature layer.
+ *
+ * The layer wraps a feature layer which has already been fitted,
+ * for example one which was loaded from a model and modified, and
+ * does not fit it again. A model with a frozen feature layer can be
+ * fitted to project the training set and fit the classifier without
+ * recomputing the feature layer.
+ */
+#include "frozenfeaturelayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a frozen feature layer. The wrapped layer is
+ * not owned by the frozen layer.
+ *
+ * @param layer
+ */
+FrozenFeatureLayer::FrozenFeatureLayer(FeatureLayer *layer)
+{
+	_layer = layer;
+}
+
+
+
+/**
+ * Do nothing, since the wrapped layer is already fitted.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void FrozenFeatureLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+}
+
+
+
+/**
+ * Project a matrix with the wrapped layer.
+ *
+ * @param X
+ */
+Matrix FrozenFeatureLayer::project(const Matrix& X)
+{
+	return _layer->project(X);
+}
+
+
+
+/**
+ * Save the wrapped layer to a file.
+ *
+ * @param file
+ */
+void FrozenFeatureLayer::save(std::ofstream& file)
+{
+	_layer->save(file);
+}
+
+
+
+/**
+ * Load the wrapped layer from a file.
+ *
+ * @param file
+ */
+void FrozenFeatureLayer::load(std::ifstream& file)
+{
+	_layer->load(file);
+}
+
+
+
+/**
+ * Print information about the wrapped layer.
+ */
+void FrozenFeatureLayer::print()
+{
+	_layer->print();
+}
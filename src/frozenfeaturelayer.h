@@ -0,0 +1,34 @@
+/**
+ * @file frozenfeaturelayer.h
+ *
+ * Interface definitions for the frozen feature layer.
+ */
+#ifndef FROZENFEATURELAYER_H
+#define FROZENFEATURELAYER_H
+
+#include <fstream>
+#include <mlearn.h>
+#include <vector>
+
+
+
+class FrozenFeatureLayer : public ML::FeatureLayer {
+private:
+	ML::FeatureLayer *_layer;
+
+public:
+	FrozenFeatureLayer(ML::FeatureLayer *layer);
+	~FrozenFeatureLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+
+	void print();
+};
+
+
+
+#endif
@@ -0,0 +1,1098 @@
+/**
+ * @file gallerylayer.cpp
+ *
+ * Implementation of the gallery kNN layer.
+ *
+ * The gallery stores the projected training set and performs an
+ * exact k-nearest-neighbors search for each query. Distances are
+ * accumulated in chunks of dimensions, and a candidate is abandoned
+ * as soon as its partial distance exceeds the largest distance which
+ * could still affect the result (the k-th best distance, the nearest
+ * competing class, or the rejection threshold). The same search
+ * also ranks the classes nearest to a query, which is used by the
+ * stages of the cascade layer.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include "gallerylayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a neighbor set.
+ *
+ * @param k
+ * @param threshold
+ */
+NeighborSet::NeighborSet(int k, float threshold)
+{
+	_k = k;
+	_threshold = threshold;
+	_neighbors.reserve(k + 1);
+
+	_dist_nearest = std::numeric_limits<float>::infinity();
+	_y_nearest = -1;
+	_dist_other = std::numeric_limits<float>::infinity();
+}
+
+
+
+/**
+ * Get the largest distance which could still change the
+ * result: the k-th best distance or the distance to the
+ * nearest competing class, whichever is larger, but never
+ * more than the rejection threshold.
+ */
+float NeighborSet::bound() const
+{
+	float dist_kth = ((int) _neighbors.size() < _k)
+		? std::numeric_limits<float>::infinity()
+		: _neighbors.back().first;
+
+	return std::min(_threshold, std::max(dist_kth, _dist_other));
+}
+
+
+
+/**
+ * Determine whether the neighbor set has a finite bound.
+ */
+bool NeighborSet::ready() const
+{
+	return bound() < std::numeric_limits<float>::infinity();
+}
+
+
+
+/**
+ * Add a sample to the neighbor set.
+ *
+ * @param dist
+ * @param y
+ */
+void NeighborSet::push(float dist, int y)
+{
+	if ( dist > bound() ) {
+		return;
+	}
+
+	// update nearest competing class
+	if ( y == _y_nearest ) {
+		_dist_nearest = std::min(_dist_nearest, dist);
+	}
+	else if ( dist < _dist_nearest ) {
+		_dist_other = _dist_nearest;
+		_dist_nearest = dist;
+		_y_nearest = y;
+	}
+	else {
+		_dist_other = std::min(_dist_other, dist);
+	}
+
+	// insert sample into top-k neighbors
+	if ( (int) _neighbors.size() < _k || dist < _neighbors.back().first ) {
+		auto pos = std::upper_bound(
+			_neighbors.begin(), _neighbors.end(),
+			std::make_pair(dist, y)
+		);
+		_neighbors.insert(pos, std::make_pair(dist, y));
+
+		if ( (int) _neighbors.size() > _k ) {
+			_neighbors.pop_back();
+		}
+	}
+}
+
+
+
+/**
+ * Determine the label of the neighbor set by majority vote,
+ * with ties going to the nearest class. Also returns the
+ * distance to the predicted class and the distance to the
+ * nearest competing class, which is only meaningful if the
+ * predicted class is also the nearest class.
+ *
+ * @param num_classes
+ * @param dist
+ * @param dist_other
+ */
+int NeighborSet::vote(int num_classes, float& dist, float& dist_other) const
+{
+	std::vector<int> counts(num_classes, 0);
+	int y_pred = _neighbors.front().second;
+
+	for ( auto& n : _neighbors ) {
+		counts[n.second]++;
+
+		if ( counts[n.second] > counts[y_pred] ) {
+			y_pred = n.second;
+		}
+	}
+
+	for ( auto& n : _neighbors ) {
+		if ( n.second == y_pred ) {
+			dist = n.first;
+			break;
+		}
+	}
+
+	dist_other = (y_pred == _y_nearest)
+		? std::min(_dist_other, _threshold)
+		: dist;
+
+	return y_pred;
+}
+
+
+
+/**
+ * Construct a ranking of the n nearest classes.
+ *
+ * @param n
+ */
+ClassRanking::ClassRanking(int n)
+{
+	_n = n;
+	_classes.reserve(n + 1);
+}
+
+
+
+/**
+ * Get the largest distance which could still change the
+ * ranking: the distance of the n-th class.
+ */
+float ClassRanking::bound() const
+{
+	return ((int) _classes.size() < _n)
+		? std::numeric_limits<float>::infinity()
+		: _classes.back().first;
+}
+
+
+
+/**
+ * Determine whether the ranking has a finite bound.
+ */
+bool ClassRanking::ready() const
+{
+	return bound() < std::numeric_limits<float>::infinity();
+}
+
+
+
+/**
+ * Add a sample to the ranking, which either moves its class
+ * closer or inserts its class among the n nearest classes.
+ *
+ * @param dist
+ * @param y
+ */
+void ClassRanking::push(float dist, int y)
+{
+	if ( dist > bound() ) {
+		return;
+	}
+
+	auto it = std::find_if(_classes.begin(), _classes.end(), [y] (const std::pair<float, int>& t) {
+		return t.second == y;
+	});
+
+	if ( it != _classes.end() ) {
+		it->first = std::min(it->first, dist);
+	}
+	else {
+		_classes.push_back(std::make_pair(dist, y));
+	}
+
+	std::sort(_classes.begin(), _classes.end());
+
+	if ( (int) _classes.size() > _n ) {
+		_classes.pop_back();
+	}
+}
+
+
+
+/**
+ * Construct a gallery layer.
+ *
+ * @param k
+ * @param dist
+ * @param threshold
+ * @param chunk
+ * @param block
+ * @param prefilter
+ * @param num_centroids
+ */
+GalleryLayer::GalleryLayer(int k, MatchDist dist, float threshold, int chunk, int block, int prefilter, int num_centroids)
+{
+	_k = k;
+	_dist = dist;
+	_threshold = threshold;
+	_chunk = chunk;
+	_block = block;
+	_prefilter = prefilter;
+	_num_centroids = num_centroids;
+
+	_num_samples = 0;
+	_num_dims = 0;
+	_num_chunks = 0;
+	_num_blocks = 0;
+	_num_classes = 0;
+
+	_num_queries = 0;
+	_num_candidates = 0;
+	_num_abandoned = 0;
+	_dims_computed = 0;
+	_centroids_computed = 0;
+}
+
+
+
+/**
+ * Convert a distance from the user-facing metric to the
+ * metric which is accumulated during the search. L2 is
+ * accumulated as a squared distance, and COS is computed
+ * as a squared L2 distance between unit vectors.
+ *
+ * @param dist
+ */
+float GalleryLayer::to_internal(float dist) const
+{
+	switch ( _dist ) {
+	case MatchDist::L2:
+		return dist * dist;
+	case MatchDist::COS:
+		return 2 * dist;
+	default:
+		return dist;
+	}
+}
+
+
+
+/**
+ * Convert an accumulated distance to the user-facing metric.
+ *
+ * @param dist
+ */
+float GalleryLayer::to_external(float dist) const
+{
+	switch ( _dist ) {
+	case MatchDist::L2:
+		return sqrtf(dist);
+	case MatchDist::COS:
+		return dist / 2;
+	default:
+		return dist;
+	}
+}
+
+
+
+/**
+ * Copy a column of a data matrix into a zero-padded buffer,
+ * normalizing it to unit length for the COS distance.
+ *
+ * @param X
+ * @param i
+ * @param x
+ */
+void GalleryLayer::load_sample(const Matrix& X, int i, float *x) const
+{
+	float norm = 0;
+
+	for ( int j = 0; j < _num_dims; j++ ) {
+		x[j] = X.elem(j, i);
+		norm += x[j] * x[j];
+	}
+
+	for ( int j = _num_dims; j < _num_chunks * _chunk; j++ ) {
+		x[j] = 0;
+	}
+
+	if ( _dist == MatchDist::COS && norm > 0 ) {
+		norm = sqrtf(norm);
+
+		for ( int j = 0; j < _num_dims; j++ ) {
+			x[j] /= norm;
+		}
+	}
+}
+
+
+
+/**
+ * Compute the chi-square term of a pair of histogram bins.
+ * The denominator is offset by the smallest normal float,
+ * so that a pair of empty bins contributes zero without a
+ * branch in the inner loops.
+ *
+ * @param a
+ * @param b
+ */
+inline float chi2_term(float a, float b)
+{
+	float t = a - b;
+	return t * t / (a + b + std::numeric_limits<float>::min());
+}
+
+
+
+/**
+ * Compute the contribution of one chunk of dimensions to the
+ * distance between a sample and each sample in a block of the
+ * gallery. Each lane of the inner loop handles one gallery
+ * sample, so the loop maps directly onto SIMD registers.
+ *
+ * @param dist
+ * @param chunk
+ * @param x
+ * @param B
+ * @param partial
+ */
+template <int W>
+void block_dist(MatchDist dist, int chunk, const float *x, const float *B, float *partial)
+{
+	float sum[W] = { 0 };
+
+	if ( dist == MatchDist::L1 ) {
+		for ( int j = 0; j < chunk; j++ ) {
+			for ( int l = 0; l < W; l++ ) {
+				sum[l] += fabsf(x[j] - B[j * W + l]);
+			}
+		}
+	}
+	else if ( dist == MatchDist::CHI2 ) {
+		for ( int j = 0; j < chunk; j++ ) {
+			for ( int l = 0; l < W; l++ ) {
+				sum[l] += chi2_term(x[j], B[j * W + l]);
+			}
+		}
+	}
+	else {
+		for ( int j = 0; j < chunk; j++ ) {
+			for ( int l = 0; l < W; l++ ) {
+				float t = x[j] - B[j * W + l];
+				sum[l] += t * t;
+			}
+		}
+	}
+
+	for ( int l = 0; l < W; l++ ) {
+		partial[l] += sum[l];
+	}
+}
+
+
+
+/**
+ * Compute the contribution of one chunk of dimensions to
+ * the distance between a sample and a block of the gallery.
+ *
+ * @param x
+ * @param c
+ * @param b
+ * @param partial
+ */
+void GalleryLayer::chunk_dist(const float *x, int c, int b, float *partial)
+{
+	const float *x_c = &x[c * _chunk];
+	const float *B = block_ptr(c, b);
+
+	switch ( _block ) {
+	case 1:
+		block_dist<1>(_dist, _chunk, x_c, B, partial);
+		break;
+	case 8:
+		block_dist<8>(_dist, _chunk, x_c, B, partial);
+		break;
+	case 16:
+		block_dist<16>(_dist, _chunk, x_c, B, partial);
+		break;
+	}
+
+	_dims_computed += _block * _chunk;
+}
+
+
+
+/**
+ * Complete the distance between a sample and a gallery sample
+ * whose first chunk has already been computed, abandoning the
+ * computation once the partial distance exceeds a limit.
+ *
+ * @param x
+ * @param i
+ * @param sum
+ * @param limit
+ */
+float GalleryLayer::complete_dist(const float *x, int i, float sum, float limit)
+{
+	int b = i / _block;
+	int l = i % _block;
+
+	for ( int c = 1; c < _num_chunks && sum <= limit; c++ ) {
+		const float *x_c = &x[c * _chunk];
+		const float *B = block_ptr(c, b);
+
+		if ( _dist == MatchDist::L1 ) {
+			for ( int j = 0; j < _chunk; j++ ) {
+				sum += fabsf(x_c[j] - B[j * _block + l]);
+			}
+		}
+		else if ( _dist == MatchDist::CHI2 ) {
+			for ( int j = 0; j < _chunk; j++ ) {
+				sum += chi2_term(x_c[j], B[j * _block + l]);
+			}
+		}
+		else {
+			for ( int j = 0; j < _chunk; j++ ) {
+				float t = x_c[j] - B[j * _block + l];
+				sum += t * t;
+			}
+		}
+
+		_dims_computed += _chunk;
+	}
+
+	return sum;
+}
+
+
+
+/**
+ * Compute the distance between a sample and a centroid over
+ * a range of chunks, abandoning the computation once the
+ * distance exceeds a limit.
+ *
+ * @param x
+ * @param m
+ * @param c_begin
+ * @param c_end
+ * @param limit
+ */
+float GalleryLayer::centroid_dist(const float *x, int m, int c_begin, int c_end, float limit) const
+{
+	int num_centroids = _centroid_y.size();
+	float sum = 0;
+
+	for ( int c = c_begin; c < c_end && sum <= limit; c++ ) {
+		const float *x_c = &x[c * _chunk];
+		const float *mu = &_centroids[((size_t) c * num_centroids + m) * _chunk];
+
+		if ( _dist == MatchDist::L1 ) {
+			for ( int j = 0; j < _chunk; j++ ) {
+				sum += fabsf(x_c[j] - mu[j]);
+			}
+		}
+		else if ( _dist == MatchDist::CHI2 ) {
+			for ( int j = 0; j < _chunk; j++ ) {
+				sum += chi2_term(x_c[j], mu[j]);
+			}
+		}
+		else {
+			for ( int j = 0; j < _chunk; j++ ) {
+				float t = x_c[j] - mu[j];
+				sum += t * t;
+			}
+		}
+	}
+
+	return sum;
+}
+
+
+
+/**
+ * Select the classes and gallery blocks to search for a sample.
+ *
+ * Without a prefilter, every class and block is selected.
+ * Otherwise, the sample is compared to the centroids of each
+ * class and only the closest classes are selected. Centroids
+ * are ranked by the first chunk of their distance, which is a
+ * lower bound on the full distance, so that most centroids
+ * are never completed. Since the gallery is sorted by class,
+ * the blocks of each selected class form a contiguous range.
+ *
+ * @param x
+ */
+void GalleryLayer::select_blocks(const float *x)
+{
+	_alive.clear();
+
+	if ( _prefilter <= 0 || _prefilter >= _num_classes ) {
+		std::fill(_selected.begin(), _selected.end(), true);
+
+		for ( int b = 0; b < _num_blocks; b++ ) {
+			_alive.push_back(b);
+		}
+		return;
+	}
+
+	// compute the first chunk of the distance to each centroid
+	const float INF = std::numeric_limits<float>::infinity();
+	int num_centroids = _centroid_y.size();
+	std::vector<std::pair<float, int>> partial(num_centroids);
+
+	for ( int m = 0; m < num_centroids; m++ ) {
+		partial[m] = std::make_pair(centroid_dist(x, m, 0, 1, INF), m);
+	}
+
+	std::sort(partial.begin(), partial.end());
+
+	// complete centroids in order of their partial distance until
+	// no remaining centroid can displace one of the closest classes
+	std::vector<std::pair<float, int>> top;
+
+	for ( int s = 0; s < num_centroids; s++ ) {
+		float bound = ((int) top.size() < _prefilter) ? INF : top.back().first;
+
+		if ( partial[s].first > bound ) {
+			break;
+		}
+
+		int m = partial[s].second;
+		int y = _centroid_y[m];
+		float dist = centroid_dist(x, m, 1, _num_chunks, bound - partial[s].first) + partial[s].first;
+
+		_centroids_computed++;
+
+		if ( dist > bound ) {
+			continue;
+		}
+
+		auto it = std::find_if(top.begin(), top.end(), [y] (const std::pair<float, int>& t) {
+			return t.second == y;
+		});
+
+		if ( it != top.end() ) {
+			it->first = std::min(it->first, dist);
+		}
+		else {
+			top.push_back(std::make_pair(dist, y));
+		}
+
+		std::sort(top.begin(), top.end());
+
+		if ( (int) top.size() > _prefilter ) {
+			top.pop_back();
+		}
+	}
+
+	// select the blocks of the closest classes
+	std::fill(_selected.begin(), _selected.end(), false);
+
+	for ( auto& t : top ) {
+		_selected[t.second] = true;
+	}
+
+	select_classes();
+}
+
+
+
+/**
+ * Select the gallery blocks of the selected classes. Since
+ * the gallery is sorted by class, the blocks of each class
+ * form a contiguous range.
+ */
+void GalleryLayer::select_classes()
+{
+	_alive.clear();
+
+	for ( int y = 0; y < _num_classes; y++ ) {
+		if ( _selected[y] && _class_begin[y] < _class_begin[y + 1] ) {
+			int b_begin = _class_begin[y] / _block;
+			int b_end = (_class_begin[y + 1] - 1) / _block;
+
+			for ( int b = b_begin; b <= b_end; b++ ) {
+				_alive.push_back(b);
+			}
+		}
+	}
+
+	// remove blocks shared by adjacent classes
+	_alive.erase(std::unique(_alive.begin(), _alive.end()), _alive.end());
+}
+
+
+
+/**
+ * Search the selected blocks of the gallery for the samples
+ * nearest to a sample, and add them to a collector, which
+ * provides the largest distance that could still change its
+ * result, like a neighbor set or a class ranking.
+ *
+ * The search proceeds one chunk of dimensions at a time over
+ * the selected blocks. Since projected features are ordered by
+ * decreasing variance, the first chunk accounts for most of
+ * the distance. The closest candidates after the first chunk
+ * are completed to establish a bound, and every remaining
+ * block of candidates is dropped as soon as the partial
+ * distance of each sample in the block exceeds the bound, so
+ * that later chunks are only read for the few blocks which
+ * survive.
+ *
+ * @param x
+ * @param collector
+ * @param num_seeds
+ */
+template <class Collector>
+void GalleryLayer::scan(const float *x, Collector& collector, int num_seeds)
+{
+	const float INF = std::numeric_limits<float>::infinity();
+
+	// compute the first chunk for every candidate
+	std::vector<int> order;
+
+	for ( int b : _alive ) {
+		float *partial = &_partial[b * _block];
+
+		std::fill(partial, partial + _block, 0.0f);
+		chunk_dist(x, 0, b, partial);
+
+		// exclude padding and samples from classes which were not selected
+		for ( int l = 0; l < _block; l++ ) {
+			int i = b * _block + l;
+
+			if ( i < _num_samples && _selected[_y[i]] ) {
+				order.push_back(i);
+			}
+			else {
+				partial[l] = INF;
+			}
+		}
+	}
+
+	int num_candidates = order.size();
+
+	// complete the closest candidates to establish a bound
+	num_seeds = std::min(num_candidates, num_seeds);
+
+	std::partial_sort(order.begin(), order.begin() + num_seeds, order.end(), [this] (int a, int b) {
+		return _partial[a] < _partial[b];
+	});
+
+	int num_completed = 0;
+
+	for ( int s = 0; s < num_candidates; s++ ) {
+		if ( s >= num_seeds && collector.ready() ) {
+			break;
+		}
+
+		int i = order[s];
+
+		collector.push(complete_dist(x, i, _partial[i], collector.bound()), _y[i]);
+		_partial[i] = INF;
+		num_completed++;
+	}
+
+	// filter the remaining blocks one chunk at a time
+	float bound = collector.bound();
+
+	auto is_alive = [this, bound] (int b) {
+		for ( int l = 0; l < _block; l++ ) {
+			if ( _partial[b * _block + l] <= bound ) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	size_t num_alive = 0;
+
+	for ( int b : _alive ) {
+		if ( is_alive(b) ) {
+			_alive[num_alive++] = b;
+		}
+	}
+
+	_alive.resize(num_alive);
+
+	for ( int c = 1; c < _num_chunks && !_alive.empty(); c++ ) {
+		size_t num_alive = 0;
+
+		for ( int b : _alive ) {
+			chunk_dist(x, c, b, &_partial[b * _block]);
+
+			if ( is_alive(b) ) {
+				_alive[num_alive++] = b;
+			}
+		}
+
+		_alive.resize(num_alive);
+	}
+
+	// add the surviving candidates to the collector
+	int num_survived = 0;
+
+	for ( int b : _alive ) {
+		for ( int l = 0; l < _block; l++ ) {
+			int i = b * _block + l;
+
+			if ( _partial[i] <= bound ) {
+				collector.push(_partial[i], _y[i]);
+				num_survived++;
+			}
+		}
+	}
+
+	_num_queries++;
+	_num_candidates += num_candidates;
+	_num_abandoned += num_candidates - num_completed - num_survived;
+}
+
+
+
+/**
+ * Find the k nearest neighbors of a sample and
+ * determine its label by majority vote. If a prefilter
+ * is enabled, only the blocks of the classes selected
+ * by the prefilter are searched.
+ *
+ * @param x
+ */
+Match GalleryLayer::search(const float *x)
+{
+	const float INF = std::numeric_limits<float>::infinity();
+
+	float threshold = (_threshold > 0) ? to_internal(_threshold) : INF;
+	NeighborSet neighbors(_k, threshold);
+
+	select_blocks(x);
+	scan(x, neighbors, 2 * _k + 2);
+
+	// reject sample if no neighbor is within the threshold
+	if ( neighbors.empty() ) {
+		return Match { -1, to_external(threshold), 0 };
+	}
+
+	float dist;
+	float dist_other;
+	int y_pred = neighbors.vote(_num_classes, dist, dist_other);
+
+	return Match {
+		y_pred,
+		to_external(dist),
+		to_external(dist_other) - to_external(dist)
+	};
+}
+
+
+
+/**
+ * Store the training set as the gallery.
+ *
+ * The gallery is stored one chunk of dimensions at a time,
+ * so that the first chunk of every sample is contiguous and
+ * can be streamed through the cache in a single pass. Within
+ * a chunk, samples are grouped into blocks with dimensions
+ * interleaved, so that consecutive elements of a block hold
+ * the same dimension of consecutive samples. Samples are
+ * sorted by class so that each class occupies a contiguous
+ * range of blocks.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void GalleryLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	_num_samples = X.cols();
+	_num_dims = X.rows();
+	_num_chunks = (_num_dims + _chunk - 1) / _chunk;
+	_num_blocks = (_num_samples + _block - 1) / _block;
+	_num_classes = c;
+
+	// sort samples by class
+	std::vector<int> indices(_num_samples);
+
+	for ( int i = 0; i < _num_samples; i++ ) {
+		indices[i] = i;
+	}
+
+	std::stable_sort(indices.begin(), indices.end(), [&y] (int a, int b) {
+		return y[a] < y[b];
+	});
+
+	_y.resize(_num_samples);
+	_class_begin.assign(c + 1, 0);
+
+	for ( int i = 0; i < _num_samples; i++ ) {
+		_y[i] = y[indices[i]];
+		_class_begin[_y[i] + 1]++;
+	}
+
+	for ( int i = 0; i < c; i++ ) {
+		_class_begin[i + 1] += _class_begin[i];
+	}
+
+	// load samples into the gallery
+	const int num_dims = _num_chunks * _chunk;
+	std::vector<float> samples((size_t) _num_samples * num_dims);
+
+	_X.assign((size_t) _num_chunks * _num_blocks * _chunk * _block, 0.0f);
+	_partial.resize(_num_blocks * _block);
+	_alive.reserve(_num_blocks);
+	_selected.resize(c);
+
+	for ( int i = 0; i < _num_samples; i++ ) {
+		float *x = &samples[(size_t) i * num_dims];
+
+		load_sample(X, indices[i], x);
+
+		int b = i / _block;
+		int l = i % _block;
+
+		for ( int c = 0; c < _num_chunks; c++ ) {
+			float *B = &_X[((size_t) c * _num_blocks + b) * _chunk * _block];
+
+			for ( int j = 0; j < _chunk; j++ ) {
+				B[j * _block + l] = x[c * _chunk + j];
+			}
+		}
+	}
+
+	// compute class centroids for the prefilter
+	_centroids.clear();
+	_centroid_y.clear();
+
+	if ( _prefilter > 0 ) {
+		for ( int k = 0; k < c; k++ ) {
+			compute_centroids(&samples[(size_t) _class_begin[k] * num_dims], _class_begin[k + 1] - _class_begin[k], k);
+		}
+
+		// store centroids one chunk at a time, like the gallery
+		int num_centroids = _centroid_y.size();
+		std::vector<float> centroids(_centroids.size());
+
+		for ( int m = 0; m < num_centroids; m++ ) {
+			for ( int c = 0; c < _num_chunks; c++ ) {
+				std::copy(
+					&_centroids[(size_t) m * num_dims + c * _chunk],
+					&_centroids[(size_t) m * num_dims + (c + 1) * _chunk],
+					&centroids[((size_t) c * num_centroids + m) * _chunk]
+				);
+			}
+		}
+
+		_centroids.swap(centroids);
+	}
+}
+
+
+
+/**
+ * Compute the centroids of a class with k-means clustering.
+ * If a class has no more samples than the number of centroids,
+ * its samples are used as the centroids.
+ *
+ * @param X
+ * @param n
+ * @param y
+ */
+void GalleryLayer::compute_centroids(const float *X, int n, int y)
+{
+	const int MAX_ITER = 10;
+	const int num_dims = _num_chunks * _chunk;
+	int m = std::min(_num_centroids, n);
+
+	// initialize centroids to evenly spaced samples
+	std::vector<float> mu((size_t) m * num_dims);
+
+	for ( int i = 0; i < m; i++ ) {
+		const float *x = &X[(size_t) (i * n / m) * num_dims];
+
+		std::copy(x, x + num_dims, &mu[(size_t) i * num_dims]);
+	}
+
+	// perform Lloyd iterations
+	std::vector<int> assign(n, -1);
+
+	for ( int iter = 0; iter < MAX_ITER && m < n; iter++ ) {
+		bool changed = false;
+
+		for ( int i = 0; i < n; i++ ) {
+			float dist_min = std::numeric_limits<float>::infinity();
+			int a = 0;
+
+			for ( int j = 0; j < m; j++ ) {
+				float sum = 0;
+
+				for ( int l = 0; l < num_dims; l++ ) {
+					float t = X[(size_t) i * num_dims + l] - mu[(size_t) j * num_dims + l];
+					sum += t * t;
+				}
+
+				if ( sum < dist_min ) {
+					dist_min = sum;
+					a = j;
+				}
+			}
+
+			changed = changed || (assign[i] != a);
+			assign[i] = a;
+		}
+
+		if ( !changed ) {
+			break;
+		}
+
+		std::vector<int> counts(m, 0);
+		std::fill(mu.begin(), mu.end(), 0.0f);
+
+		for ( int i = 0; i < n; i++ ) {
+			counts[assign[i]]++;
+
+			for ( int l = 0; l < num_dims; l++ ) {
+				mu[(size_t) assign[i] * num_dims + l] += X[(size_t) i * num_dims + l];
+			}
+		}
+
+		for ( int j = 0; j < m; j++ ) {
+			for ( int l = 0; l < num_dims; l++ ) {
+				mu[(size_t) j * num_dims + l] /= std::max(counts[j], 1);
+			}
+		}
+	}
+
+	_centroids.insert(_centroids.end(), mu.begin(), mu.end());
+	_centroid_y.insert(_centroid_y.end(), m, y);
+}
+
+
+
+/**
+ * Classify a set of samples with the gallery.
+ *
+ * @param X_test
+ */
+std::vector<int> GalleryLayer::predict(const Matrix& X_test)
+{
+	assert(X_test.rows() == _num_dims);
+
+	std::vector<float> x(_num_chunks * _chunk);
+	std::vector<int> y_pred(X_test.cols());
+
+	_matches.resize(X_test.cols());
+
+	for ( int i = 0; i < X_test.cols(); i++ ) {
+		load_sample(X_test, i, x.data());
+
+		_matches[i] = search(x.data());
+		y_pred[i] = _matches[i].y;
+	}
+
+	return y_pred;
+}
+
+
+
+/**
+ * Rank the n classes nearest to column i of a data matrix
+ * by the distance to their nearest sample. If the selection
+ * is not empty, only the selected classes are ranked.
+ *
+ * @param X
+ * @param i
+ * @param n
+ * @param selected
+ */
+std::vector<std::pair<float, int>> GalleryLayer::rank(const Matrix& X, int i, int n, const std::vector<bool>& selected)
+{
+	assert(X.rows() == _num_dims);
+
+	std::vector<float> x(_num_chunks * _chunk);
+	ClassRanking ranking(n);
+
+	load_sample(X, i, x.data());
+
+	if ( selected.empty() ) {
+		select_blocks(x.data());
+	}
+	else {
+		_selected = selected;
+		select_classes();
+	}
+
+	scan(x.data(), ranking, 2 * n + 2);
+
+	std::vector<std::pair<float, int>> classes = ranking.classes();
+
+	for ( auto& t : classes ) {
+		t.first = to_external(t.first);
+	}
+
+	return classes;
+}
+
+
+
+/**
+ * Print information about a gallery layer.
+ */
+void GalleryLayer::print()
+{
+	const char *dist_name = "";
+
+	if ( _dist == MatchDist::COS ) {
+		dist_name = "COS";
+	}
+	else if ( _dist == MatchDist::L1 ) {
+		dist_name = "L1";
+	}
+	else if ( _dist == MatchDist::L2 ) {
+		dist_name = "L2";
+	}
+	else if ( _dist == MatchDist::CHI2 ) {
+		dist_name = "CHI2";
+	}
+
+	log(LogLevel::Verbose, "kNN (gallery)");
+	log(LogLevel::Verbose, "  %-20s  %10d", "k", _k);
+	log(LogLevel::Verbose, "  %-20s  %10s", "dist", dist_name);
+	log(LogLevel::Verbose, "  %-20s  %10f", "reject_threshold", _threshold);
+	log(LogLevel::Verbose, "  %-20s  %10d", "chunk", _chunk);
+	log(LogLevel::Verbose, "  %-20s  %10d", "block", _block);
+	log(LogLevel::Verbose, "  %-20s  %10d", "prefilter", _prefilter);
+	log(LogLevel::Verbose, "  %-20s  %10d", "centroids", _num_centroids);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print search statistics. The fraction of dimensions which
+ * were computed is the cost of the search relative to an
+ * exhaustive search, so its inverse is the speedup from
+ * early abandoning.
+ */
+void GalleryLayer::print_stats()
+{
+	if ( _num_queries == 0 ) {
+		return;
+	}
+
+	float frac_abandoned = (float) _num_abandoned / _num_candidates;
+	float frac_computed = (float) _dims_computed / _num_candidates / (_num_chunks * _chunk);
+
+	log(LogLevel::Info, "gallery: %ld queries, %ld candidates", _num_queries, _num_candidates);
+	log(LogLevel::Info, "gallery: %.1f%% of candidates abandoned", 100 * frac_abandoned);
+	log(LogLevel::Info, "gallery: %.1f%% of dimensions computed (%.2fx speedup)", 100 * frac_computed, 1 / frac_computed);
+
+	if ( _prefilter > 0 ) {
+		float frac_searched = (float) _num_candidates / _num_queries / _num_samples;
+		float frac_centroids = (float) _centroids_computed / _num_queries / _centroid_y.size();
+
+		log(LogLevel::Info, "gallery: prefilter completed %.1f%% of centroids", 100 * frac_centroids);
+		log(LogLevel::Info, "gallery: prefilter searched %.1f%% of samples", 100 * frac_searched);
+	}
+}
@@ -0,0 +1,113 @@
+/**
+ * @file gallerylayer.h
+ *
+ * Interface definitions for the gallery kNN layer.
+ */
+#ifndef GALLERYLAYER_H
+#define GALLERYLAYER_H
+
+#include <mlearn.h>
+#include <utility>
+#include <vector>
+#include "matchlayer.h"
+
+
+
+class NeighborSet {
+private:
+	int _k;
+	float _threshold;
+	std::vector<std::pair<float, int>> _neighbors;
+
+	float _dist_nearest;
+	int _y_nearest;
+	float _dist_other;
+
+public:
+	NeighborSet(int k, float threshold);
+
+	bool empty() const { return _neighbors.empty(); }
+	float bound() const;
+	bool ready() const;
+	void push(float dist, int y);
+	int vote(int num_classes, float& dist, float& dist_other) const;
+};
+
+
+
+class ClassRanking {
+private:
+	int _n;
+	std::vector<std::pair<float, int>> _classes;
+
+public:
+	ClassRanking(int n);
+
+	const std::vector<std::pair<float, int>>& classes() const { return _classes; }
+	float bound() const;
+	bool ready() const;
+	void push(float dist, int y);
+};
+
+
+
+class GalleryLayer : public MatchLayer {
+private:
+	int _k;
+	MatchDist _dist;
+	float _threshold;
+	int _chunk;
+	int _block;
+	int _prefilter;
+	int _num_centroids;
+
+	int _num_samples;
+	int _num_dims;
+	int _num_chunks;
+	int _num_blocks;
+	int _num_classes;
+	std::vector<float> _X;
+	std::vector<int> _y;
+	std::vector<int> _class_begin;
+	std::vector<float> _centroids;
+	std::vector<int> _centroid_y;
+
+	std::vector<float> _partial;
+	std::vector<int> _alive;
+	std::vector<bool> _selected;
+
+	long _num_queries;
+	long _num_candidates;
+	long _num_abandoned;
+	long _dims_computed;
+	long _centroids_computed;
+
+	float to_internal(float dist) const;
+	float to_external(float dist) const;
+	void load_sample(const ML::Matrix& X, int i, float *x) const;
+	const float * block_ptr(int c, int b) const { return &_X[((size_t) c * _num_blocks + b) * _chunk * _block]; }
+	void chunk_dist(const float *x, int c, int b, float *partial);
+	float complete_dist(const float *x, int i, float sum, float limit);
+	void compute_centroids(const float *X, int n, int y);
+	float centroid_dist(const float *x, int m, int c_begin, int c_end, float limit) const;
+	void select_blocks(const float *x);
+	void select_classes();
+	template <class Collector>
+	void scan(const float *x, Collector& collector, int num_seeds);
+	Match search(const float *x);
+
+public:
+	GalleryLayer(int k, MatchDist dist, float threshold, int chunk, int block, int prefilter, int num_centroids);
+	~GalleryLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	std::vector<int> predict(const ML::Matrix& X_test);
+	std::vector<std::pair<float, int>> rank(const ML::Matrix& X, int i, int n, const std::vector<bool>& selected);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
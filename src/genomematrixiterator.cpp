@@ -0,0 +1,375 @@
+/**
+ * @file genomematrixiterator.cpp
+ *
+ * Implementation of the memory-mapped genome iterator.
+ *
+ * The iterator reads a binary expression matrix created by
+ * scripts/pack-genome.py. The file is memory-mapped rather than
+ * read, so only the pages of the samples which are actually used
+ * are brought into memory. The matrix is stored with one row per
+ * sample, either dense or in CSR format, and each sample is
+ * expanded into a dense column only when it is requested. A CSR
+ * matrix can also be read directly as sparse batches.
+ *
+ * Every offset and size in the header is checked against the size
+ * of the file, and the row pointers and column indices of a CSR
+ * matrix are checked once when the file is opened, so that a
+ * truncated or corrupt file is rejected instead of being read out
+ * of bounds.
+ */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "genomematrixiterator.h"
+
+
+
+using namespace ML;
+
+
+
+typedef struct {
+	char magic[4];
+	int32_t version;
+	int32_t storage;
+	int32_t num_samples;
+	int32_t num_genes;
+	int32_t reserved;
+	int64_t nnz;
+	int64_t data_offset;
+	int64_t entries_offset;
+	int64_t entries_size;
+} genome_header_t;
+
+
+
+/**
+ * Construct a genome iterator from a packed expression matrix.
+ *
+ * @param path
+ */
+GenomeMatrixIterator::GenomeMatrixIterator(const std::string& path)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// map file into memory
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+
+	if ( fd == -1 || fstat(fd, &st) == -1 ) {
+		std::cerr << "error: could not open " << path << "\n";
+		exit(1);
+	}
+
+	_map_size = st.st_size;
+	_map = mmap(nullptr, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( _map == MAP_FAILED ) {
+		std::cerr << "error: could not map " << path << "\n";
+		exit(1);
+	}
+
+	// read header
+	const char *base = static_cast<const char *>(_map);
+	genome_header_t header;
+
+	auto corrupt = [&path] (const char *reason) {
+		std::cerr << "error: " << path << " is corrupt (" << reason << ")\n";
+		exit(1);
+	};
+
+	if ( _map_size < sizeof(header) ) {
+		std::cerr << "error: " << path << " is not a packed genome matrix\n";
+		exit(1);
+	}
+
+	memcpy(&header, base, sizeof(header));
+
+	if ( memcmp(header.magic, "GMAT", 4) != 0 || header.version != 1 ) {
+		std::cerr << "error: " << path << " is not a packed genome matrix\n";
+		exit(1);
+	}
+
+	if ( header.storage != (int32_t) GenomeStorage::Dense && header.storage != (int32_t) GenomeStorage::CSR ) {
+		corrupt("unknown storage format");
+	}
+
+	if ( header.num_samples <= 0 || header.num_genes <= 0 ) {
+		corrupt("invalid dimensions");
+	}
+
+	_storage = (GenomeStorage) header.storage;
+	_num_samples = header.num_samples;
+	_num_genes = header.num_genes;
+	_nnz = header.nnz;
+
+	// validate the matrix and entries against the size of the file
+	const uint64_t map_size = _map_size;
+	const uint64_t num_samples = _num_samples;
+	const uint64_t num_genes = _num_genes;
+
+	if ( _storage == GenomeStorage::Dense && (uint64_t) _nnz != num_samples * num_genes ) {
+		corrupt("invalid number of nonzeros");
+	}
+
+	if ( _nnz < 0 || (uint64_t) _nnz > num_samples * num_genes || (uint64_t) _nnz > map_size ) {
+		corrupt("invalid number of nonzeros");
+	}
+
+	uint64_t data_size = (_storage == GenomeStorage::Dense)
+		? num_samples * num_genes * sizeof(float)
+		: (num_samples + 1) * sizeof(int64_t) + _nnz * (sizeof(int32_t) + sizeof(float));
+
+	bool data_valid = header.data_offset >= (int64_t) sizeof(header)
+		&& header.data_offset % sizeof(int64_t) == 0
+		&& (uint64_t) header.data_offset <= map_size
+		&& data_size <= map_size - header.data_offset;
+	bool entries_valid = header.entries_offset >= 0
+		&& header.entries_size >= 0
+		&& (uint64_t) header.entries_offset <= map_size
+		&& (uint64_t) header.entries_size <= map_size - header.entries_offset;
+
+	if ( !data_valid ) {
+		corrupt("matrix is truncated");
+	}
+
+	if ( !entries_valid ) {
+		corrupt("entries are truncated");
+	}
+
+	// locate matrix data
+	const char *data = base + header.data_offset;
+
+	if ( _storage == GenomeStorage::Dense ) {
+		_values = reinterpret_cast<const float *>(data);
+		_row_ptr = nullptr;
+		_col_idx = nullptr;
+	}
+	else {
+		_row_ptr = reinterpret_cast<const int64_t *>(data);
+		_col_idx = reinterpret_cast<const int32_t *>(data + (_num_samples + 1) * sizeof(int64_t));
+		_values = reinterpret_cast<const float *>(data + (_num_samples + 1) * sizeof(int64_t) + _nnz * sizeof(int32_t));
+
+		// validate the row pointers and column indices, which are
+		// used as indices without further checks
+		if ( _row_ptr[0] != 0 || _row_ptr[_num_samples] != _nnz ) {
+			corrupt("invalid row pointers");
+		}
+
+		for ( int i = 0; i < _num_samples; i++ ) {
+			if ( _row_ptr[i + 1] < _row_ptr[i] ) {
+				corrupt("invalid row pointers");
+			}
+		}
+
+		for ( int64_t k = 0; k < _nnz; k++ ) {
+			if ( _col_idx[k] < 0 || _col_idx[k] >= _num_genes ) {
+				corrupt("invalid column index");
+			}
+		}
+	}
+
+	// read entries
+	const char *p = base + header.entries_offset;
+	const char *end = p + header.entries_size;
+
+	while ( p < end ) {
+		const char *tab = static_cast<const char *>(memchr(p, '\t', end - p));
+
+		if ( tab == nullptr ) {
+			corrupt("invalid entry");
+		}
+
+		const char *newline = static_cast<const char *>(memchr(tab, '\n', end - tab));
+
+		if ( newline == nullptr ) {
+			corrupt("invalid entry");
+		}
+
+		_entries.push_back(DataEntry {
+			std::string(p, tab),
+			std::string(tab + 1, newline)
+		});
+
+		p = newline + 1;
+	}
+
+	if ( (int) _entries.size() != _num_samples ) {
+		corrupt("number of entries does not match the number of samples");
+	}
+
+	auto stop = std::chrono::steady_clock::now();
+
+	_open_time = std::chrono::duration<float>(stop - start).count();
+	_sample_time = 0;
+}
+
+
+
+/**
+ * Destruct a genome iterator.
+ */
+GenomeMatrixIterator::~GenomeMatrixIterator()
+{
+	munmap(_map, _map_size);
+}
+
+
+
+/**
+ * Expand sample i into column j of a matrix.
+ *
+ * @param i
+ * @param X
+ * @param j
+ */
+void GenomeMatrixIterator::load_row(int i, Matrix& X, int j) const
+{
+	if ( _storage == GenomeStorage::Dense ) {
+		const float *x = &_values[(size_t) i * _num_genes];
+
+		for ( int k = 0; k < _num_genes; k++ ) {
+			X.elem(k, j) = x[k];
+		}
+	}
+	else {
+		for ( int k = 0; k < _num_genes; k++ ) {
+			X.elem(k, j) = 0;
+		}
+
+		for ( int64_t k = _row_ptr[i]; k < _row_ptr[i + 1]; k++ ) {
+			X.elem(_col_idx[k], j) = _values[k];
+		}
+	}
+}
+
+
+
+/**
+ * Load a sample into column i of a matrix.
+ *
+ * @param X
+ * @param i
+ */
+void GenomeMatrixIterator::sample(Matrix& X, int i)
+{
+	assert(X.rows() == this->sample_size());
+
+	auto start = std::chrono::steady_clock::now();
+
+	load_row(i, X, i);
+
+	auto end = std::chrono::steady_clock::now();
+
+	_sample_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Load the samples i, ..., i + X.cols() - 1 into the columns
+ * of a matrix, so that a data set can be processed in batches
+ * without loading it whole.
+ *
+ * @param X
+ * @param i
+ */
+void GenomeMatrixIterator::load_batch(Matrix& X, int i)
+{
+	assert(X.rows() == this->sample_size());
+	assert(i + X.cols() <= _num_samples);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for ( int j = 0; j < X.cols(); j++ ) {
+		load_row(i + j, X, j);
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	_sample_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Get a view of the samples i, ..., i + n - 1 of a CSR matrix,
+ * which reads the mapped file without expanding the samples.
+ *
+ * @param i
+ * @param n
+ */
+csr_matrix_t GenomeMatrixIterator::sparse_batch(int i, int n) const
+{
+	assert(_storage == GenomeStorage::CSR);
+	assert(i + n <= _num_samples);
+
+	return csr_matrix_t { n, _num_genes, &_row_ptr[i], _col_idx, _values };
+}
+
+
+
+/**
+ * Compute the mean sample directly from the mapped matrix.
+ */
+std::vector<float> GenomeMatrixIterator::mean() const
+{
+	std::vector<double> sum(_num_genes, 0.0);
+
+	if ( _storage == GenomeStorage::Dense ) {
+		for ( int i = 0; i < _num_samples; i++ ) {
+			const float *x = &_values[(size_t) i * _num_genes];
+
+			for ( int k = 0; k < _num_genes; k++ ) {
+				sum[k] += x[k];
+			}
+		}
+	}
+	else {
+		for ( int64_t k = 0; k < _nnz; k++ ) {
+			sum[_col_idx[k]] += _values[k];
+		}
+	}
+
+	std::vector<float> mean(_num_genes);
+
+	for ( int k = 0; k < _num_genes; k++ ) {
+		mean[k] = sum[k] / _num_samples;
+	}
+
+	return mean;
+}
+
+
+
+/**
+ * Print load statistics. The size of the mapped file is compared
+ * with the size of the equivalent dense matrix, and the peak
+ * resident memory of the process is included for reference.
+ */
+void GenomeMatrixIterator::print_stats()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	log(LogLevel::Info, "genome: %d samples, %d genes, %s, %ld nonzeros (%.1f%%)",
+		_num_samples,
+		_num_genes,
+		(_storage == GenomeStorage::Dense) ? "dense" : "CSR",
+		(long) _nnz,
+		100.0 * _nnz / ((double) _num_samples * _num_genes));
+	log(LogLevel::Info, "genome: mapped %.2f MB (dense %.2f MB), peak RSS %.2f MB",
+		_map_size / 1e6,
+		(double) _num_samples * _num_genes * sizeof(float) / 1e6,
+		usage.ru_maxrss / 1e3);
+	log(LogLevel::Info, "genome: open %.3f ms, load %.3f ms", 1000 * _open_time, 1000 * _sample_time);
+}
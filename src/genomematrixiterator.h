@@ -0,0 +1,63 @@
+/**
+ * @file genomematrixiterator.h
+ *
+ * Interface definitions for the memory-mapped genome iterator.
+ */
+#ifndef GENOMEMATRIXITERATOR_H
+#define GENOMEMATRIXITERATOR_H
+
+#include <cstdint>
+#include <mlearn.h>
+#include <string>
+#include <vector>
+#include "csrmatrix.h"
+
+
+
+enum class GenomeStorage {
+	Dense = 0,
+	CSR = 1
+};
+
+
+
+class GenomeMatrixIterator : public ML::DataIterator {
+private:
+	std::vector<ML::DataEntry> _entries;
+
+	GenomeStorage _storage;
+	int _num_samples;
+	int _num_genes;
+	int64_t _nnz;
+
+	void *_map;
+	size_t _map_size;
+	const float *_values;
+	const int64_t *_row_ptr;
+	const int32_t *_col_idx;
+
+	float _open_time;
+	float _sample_time;
+
+	void load_row(int i, ML::Matrix& X, int j) const;
+
+public:
+	GenomeMatrixIterator(const std::string& path);
+	~GenomeMatrixIterator();
+
+	int num_samples() const { return _num_samples; }
+	int sample_size() const { return _num_genes; }
+	const std::vector<ML::DataEntry>& entries() const { return _entries; }
+	bool sparse() const { return _storage == GenomeStorage::CSR; }
+
+	void sample(ML::Matrix& X, int i);
+	void load_batch(ML::Matrix& X, int i);
+	csr_matrix_t sparse_batch(int i, int n) const;
+	std::vector<float> mean() const;
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file gridlayer.cpp
+ *
+ * Implementation of the grid layer.
+ *
+ * The layer evaluates a list of classifiers on the projections of a
+ * single model, so that the feature layer of the model is fitted once
+ * and every classifier is trained and evaluated on the same data. The
+ * model labels and centers the data as usual, and the layer records
+ * the predictions and timings of each classifier. Classifiers which
+ * are implemented in this program are evaluated concurrently, while
+ * mlearn classifiers are evaluated on the calling thread, since mlearn
+ * is not thread-safe.
+ */
+#include <chrono>
+#include <thread>
+#include "gridlayer.h"
+#include "matchlayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a grid layer. The classifiers are owned by the
+ * grid layer.
+ *
+ * @param classifiers
+ */
+GridLayer::GridLayer(const std::vector<ClassifierLayer *>& classifiers)
+{
+	for ( ClassifierLayer *classifier : classifiers ) {
+		_classifiers.emplace_back(classifier);
+	}
+
+	_evals.resize(classifiers.size());
+	_eval_time = 0;
+	_c = 0;
+}
+
+
+
+/**
+ * Store the projected training set, which is used to train
+ * each classifier when the test set is predicted.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void GridLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	_P_train = X;
+	_y_train = y;
+	_c = c;
+}
+
+
+
+/**
+ * Train and evaluate each classifier on the stored training set
+ * and a projected test set. Returns the predictions of the first
+ * classifier; the predictions of every classifier are available
+ * through evals().
+ *
+ * @param X_test
+ */
+std::vector<int> GridLayer::predict(const Matrix& X_test)
+{
+	auto evaluate = [&] (int k) {
+		ClassifierLayer *classifier = _classifiers[k].get();
+		grid_eval_t& eval = _evals[k];
+
+		auto start = std::chrono::steady_clock::now();
+
+		classifier->compute(_P_train, _y_train, _c);
+
+		auto mid = std::chrono::steady_clock::now();
+
+		eval.y_pred = classifier->predict(X_test);
+
+		auto end = std::chrono::steady_clock::now();
+
+		eval.train_time = std::chrono::duration<float>(mid - start).count();
+		eval.predict_time = std::chrono::duration<float>(end - mid).count();
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+
+	for ( size_t k = 0; k < _classifiers.size(); k++ ) {
+		if ( dynamic_cast<MatchLayer *>(_classifiers[k].get()) != nullptr ) {
+			threads.emplace_back(evaluate, k);
+		}
+	}
+
+	for ( size_t k = 0; k < _classifiers.size(); k++ ) {
+		if ( dynamic_cast<MatchLayer *>(_classifiers[k].get()) == nullptr ) {
+			evaluate(k);
+		}
+	}
+
+	for ( std::thread& thread : threads ) {
+		thread.join();
+	}
+
+	_eval_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+	return _evals.empty() ? std::vector<int>() : _evals[0].y_pred;
+}
+
+
+
+/**
+ * Print information about each classifier.
+ */
+void GridLayer::print()
+{
+	for ( auto& classifier : _classifiers ) {
+		classifier->print();
+	}
+}
@@ -0,0 +1,48 @@
+/**
+ * @file gridlayer.h
+ *
+ * Interface definitions for the grid layer.
+ */
+#ifndef GRIDLAYER_H
+#define GRIDLAYER_H
+
+#include <memory>
+#include <mlearn.h>
+#include <vector>
+
+
+
+typedef struct {
+	std::vector<int> y_pred;
+	float train_time;
+	float predict_time;
+} grid_eval_t;
+
+
+
+class GridLayer : public ML::ClassifierLayer {
+private:
+	std::vector<std::unique_ptr<ML::ClassifierLayer>> _classifiers;
+	std::vector<grid_eval_t> _evals;
+	float _eval_time;
+
+	ML::Matrix _P_train;
+	std::vector<int> _y_train;
+	int _c;
+
+public:
+	GridLayer(const std::vector<ML::ClassifierLayer *>& classifiers);
+	~GridLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	std::vector<int> predict(const ML::Matrix& X_test);
+
+	const std::vector<grid_eval_t>& evals() const { return _evals; }
+	float eval_time() const { return _eval_time; }
+
+	void print();
+};
+
+
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file lanczos.cpp
+ *
+ * Implementation of the Lanczos eigensolver.
+ *
+ * The solver computes the k largest eigenpairs of a symmetric positive
+ * semi-definite operator which is only available as a matrix-vector
+ * product, with the thick-restart Lanczos method (Wu and Simon, 2000),
+ * which is mathematically equivalent to implicitly restarted Lanczos.
+ * A Krylov basis of m vectors is extended one product at a time and
+ * fully reorthogonalized, and the eigenpairs of the projected m x m
+ * matrix are the Ritz approximations. When the basis is full, the
+ * best Ritz vectors are kept and the basis is extended again from the
+ * last residual, until the residuals of the k largest Ritz pairs are
+ * small enough. Memory is O(m * n) and no n x n matrix is formed.
+ */
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "lanczos.h"
+#include "linalg.h"
+
+
+
+/**
+ * Compute the dot product of two vectors.
+ *
+ * @param x
+ * @param y
+ * @param n
+ */
+inline double dot(const double *x, const double *y, int n)
+{
+	double sum = 0;
+
+	for ( int i = 0; i < n; i++ ) {
+		sum += x[i] * y[i];
+	}
+
+	return sum;
+}
+
+
+
+/**
+ * Orthogonalize a vector against the first j vectors of a basis
+ * in place, with two passes of classical Gram-Schmidt so that
+ * orthogonality is kept to working precision. The projection
+ * coefficients are added to h.
+ *
+ * @param V
+ * @param j
+ * @param n
+ * @param w
+ * @param h
+ */
+void orthogonalize(const std::vector<double>& V, int j, int n, double *w, double *h)
+{
+	std::vector<double> c(j);
+
+	for ( int pass = 0; pass < 2; pass++ ) {
+		for ( int i = 0; i < j; i++ ) {
+			c[i] = dot(&V[(size_t) i * n], w, n);
+		}
+
+		for ( int i = 0; i < j; i++ ) {
+			const double *v_i = &V[(size_t) i * n];
+
+			for ( int l = 0; l < n; l++ ) {
+				w[l] -= c[i] * v_i[l];
+			}
+
+			h[i] += c[i];
+		}
+	}
+}
+
+
+
+/**
+ * Set basis vector j to a random unit vector which is
+ * orthogonal to the previous basis vectors.
+ *
+ * @param V
+ * @param j
+ * @param n
+ * @param rng
+ */
+void random_vector(std::vector<double>& V, int j, int n, std::mt19937& rng)
+{
+	std::normal_distribution<double> normal;
+	std::vector<double> h(j);
+	double *v = &V[(size_t) j * n];
+
+	for ( int l = 0; l < n; l++ ) {
+		v[l] = normal(rng);
+	}
+
+	orthogonalize(V, j, n, v, h.data());
+
+	double norm = sqrt(dot(v, v, n));
+
+	for ( int l = 0; l < n; l++ ) {
+		v[l] /= norm;
+	}
+}
+
+
+
+/**
+ * Compute the k largest eigenpairs of a symmetric operator of
+ * size n. On return, evecs contains the eigenvectors one after
+ * another and evals contains the eigenvalues, both in order of
+ * decreasing eigenvalue.
+ *
+ * @param matvec
+ * @param n
+ * @param k
+ * @param evecs
+ * @param evals
+ */
+lanczos_stats_t lanczos_eigen(const matvec_func_t& matvec, int n, int k, std::vector<double>& evecs, std::vector<double>& evals)
+{
+	const int MAX_RESTARTS = 200;
+	const double TOL = 1e-8;
+	const double EPS = 1e-12;
+
+	k = std::min(k, n);
+
+	int m = std::min(n, std::max(2 * k + 1, k + 16));
+	std::vector<double> V((size_t) (m + 1) * n, 0.0);
+	std::vector<double> H((size_t) m * m, 0.0);
+	std::vector<double> Y;
+	std::vector<double> theta;
+	std::vector<double> h(m);
+	std::mt19937 rng(1);
+
+	lanczos_stats_t stats = { 0, 0, false };
+
+	random_vector(V, 0, n, rng);
+
+	int l = 0;
+
+	while ( true ) {
+		// extend the basis to m vectors
+		double beta = 0;
+
+		for ( int j = l; j < m; j++ ) {
+			double *w = &V[(size_t) (j + 1) * n];
+
+			matvec(&V[(size_t) j * n], w);
+			stats.num_matvecs++;
+
+			std::fill(h.begin(), h.end(), 0.0);
+			orthogonalize(V, j + 1, n, w, h.data());
+
+			for ( int i = 0; i <= j; i++ ) {
+				H[(size_t) i * m + j] = h[i];
+				H[(size_t) j * m + i] = h[i];
+			}
+
+			beta = sqrt(dot(w, w, n));
+
+			// restart from a random vector if the basis spans an invariant subspace
+			if ( beta <= EPS * std::max(fabs(H[0]), 1.0) ) {
+				beta = 0;
+
+				if ( j + 1 < m ) {
+					random_vector(V, j + 1, n, rng);
+				}
+			}
+			else {
+				for ( int i = 0; i < n; i++ ) {
+					w[i] /= beta;
+				}
+			}
+		}
+
+		// compute the Ritz pairs
+		Y = H;
+		sym_eigen(Y, m, theta);
+
+		// check the residuals of the k largest Ritz pairs
+		double scale = std::max(fabs(theta[0]), EPS);
+		int num_converged = 0;
+
+		for ( int i = 0; i < k; i++ ) {
+			if ( fabs(beta * Y[(size_t) (m - 1) * m + i]) <= TOL * scale ) {
+				num_converged++;
+			}
+		}
+
+		stats.converged = (num_converged == k);
+
+		// keep the best Ritz vectors, or return the k largest
+		int num_keep = (stats.converged || stats.num_restarts >= MAX_RESTARTS)
+			? k
+			: std::min(k + (m - k) / 2, m - 1);
+
+		std::vector<double> X((size_t) num_keep * n, 0.0);
+
+		for ( int i = 0; i < num_keep; i++ ) {
+			double *x = &X[(size_t) i * n];
+
+			for ( int j = 0; j < m; j++ ) {
+				const double *v_j = &V[(size_t) j * n];
+				double y_ji = Y[(size_t) j * m + i];
+
+				for ( int q = 0; q < n; q++ ) {
+					x[q] += y_ji * v_j[q];
+				}
+			}
+		}
+
+		if ( num_keep == k ) {
+			evecs.swap(X);
+			evals.assign(theta.begin(), theta.begin() + k);
+			break;
+		}
+
+		// restart with the kept Ritz vectors and the last residual
+		std::copy(&V[(size_t) m * n], &V[(size_t) (m + 1) * n], &V[(size_t) num_keep * n]);
+		std::copy(X.begin(), X.end(), V.begin());
+
+		std::fill(H.begin(), H.end(), 0.0);
+
+		for ( int i = 0; i < num_keep; i++ ) {
+			H[(size_t) i * m + i] = theta[i];
+		}
+
+		l = num_keep;
+		stats.num_restarts++;
+	}
+
+	return stats;
+}
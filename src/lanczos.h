@@ -0,0 +1,28 @@
+/**
+ * @file lanczos.h
+ *
+ * Interface definitions for the Lanczos eigensolver.
+ */
+#ifndef LANCZOS_H
+#define LANCZOS_H
+
+#include <functional>
+#include <vector>
+
+
+
+typedef std::function<void(const double *x, double *y)> matvec_func_t;
+
+typedef struct {
+	int num_matvecs;
+	int num_restarts;
+	bool converged;
+} lanczos_stats_t;
+
+
+
+lanczos_stats_t lanczos_eigen(const matvec_func_t& matvec, int n, int k, std::vector<double>& evecs, std::vector<double>& evals);
+
+
+
+#endif
@@ -0,0 +1,667 @@
+/**
+ * @file lanczospcalayer.cpp
+ *
+ * Implementation of the Lanczos PCA feature layer.
+ *
+ * The layer computes the same eigenfaces as the PCA layer, but only
+ * the n1 that are requested, with the Lanczos eigensolver. The solver
+ * only needs products with the covariance matrix, which are computed
+ * as two passes over the centered data, so no full eigendecomposition
+ * is computed. When there are fewer samples than dimensions, the
+ * solver runs on the Gram operator X' * X instead, which has the same
+ * nonzero eigenvalues and shorter vectors, and the eigenfaces are
+ * recovered as X * u / sqrt(lambda).
+ *
+ * If the operator is small compared to the number of products that
+ * the solver is expected to need, it is formed explicitly with the
+ * blocked, multi-threaded rank-k update instead.
+ *
+ * A sparse training set is centered implicitly in the products, so it
+ * is never expanded into a dense matrix.
+ *
+ * Instead of a fixed number of eigenfaces, the layer can select the
+ * smallest number which explains a target fraction of the variance.
+ * The total variance is the trace of the covariance matrix, which is
+ * known from the data, so the eigenpairs are computed in rounds of
+ * doubling size until their eigenvalues reach the target.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "lanczospcalayer.h"
+#include "linalg.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a Lanczos PCA layer. If the energy target is
+ * positive, n1 is only an upper bound on the number of
+ * eigenfaces.
+ *
+ * @param n1
+ * @param energy
+ */
+LanczosPCALayer::LanczosPCALayer(int n1, float energy)
+{
+	_n1 = n1;
+	_energy = energy;
+	_explained = 0;
+
+	_num_matvecs = 0;
+	_num_restarts = 0;
+	_solve_time = 0;
+}
+
+
+
+/**
+ * Compute the top n1 eigenpairs of an operator. If there is an
+ * energy target, the eigenpairs are computed in rounds of doubling
+ * size until their eigenvalues reach the target, and the number
+ * of eigenpairs which reach it is returned.
+ *
+ * @param matvec
+ * @param n_op
+ * @param n1
+ * @param total
+ * @param evecs
+ * @param evals
+ */
+int LanczosPCALayer::solve(const matvec_func_t& matvec, int n_op, int n1, double total, std::vector<double>& evecs, std::vector<double>& evals)
+{
+	lanczos_stats_t stats = { 0, 0, false };
+	int k = (_energy > 0) ? std::min(16, n1) : n1;
+
+	while ( true ) {
+		lanczos_stats_t round = lanczos_eigen(matvec, n_op, k, evecs, evals);
+
+		stats.num_matvecs += round.num_matvecs;
+		stats.num_restarts += round.num_restarts;
+		stats.converged = round.converged;
+
+		if ( _energy <= 0 ) {
+			break;
+		}
+
+		double sum = 0;
+		int num_energy = 0;
+
+		while ( num_energy < k && sum < _energy * total ) {
+			sum += evals[num_energy];
+			num_energy++;
+		}
+
+		if ( sum >= _energy * total || k == n1 ) {
+			n1 = num_energy;
+			break;
+		}
+
+		k = std::min(2 * k, n1);
+	}
+
+	double sum = 0;
+
+	for ( int i = 0; i < n1; i++ ) {
+		sum += evals[i];
+	}
+
+	_explained = (total > 0) ? sum / total : 0;
+
+	if ( !stats.converged ) {
+		std::cerr << "warning: Lanczos did not converge for all " << n1 << " eigenpairs\n";
+	}
+
+	_num_matvecs += stats.num_matvecs;
+	_num_restarts += stats.num_restarts;
+
+	return n1;
+}
+
+
+
+/**
+ * Compute the eigenfaces of a training set.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void LanczosPCALayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int D = X.rows();
+	int N = X.cols();
+	int n1 = std::min(D, N - 1);
+
+	if ( _n1 > 0 ) {
+		n1 = std::min(_n1, n1);
+	}
+
+	// compute the mean face and the centered data
+	std::vector<double> mean(D, 0.0);
+
+	for ( int q = 0; q < N; q++ ) {
+		for ( int i = 0; i < D; i++ ) {
+			mean[i] += X.elem(i, q);
+		}
+	}
+
+	_mean.resize(D);
+
+	for ( int i = 0; i < D; i++ ) {
+		_mean[i] = mean[i] / N;
+	}
+
+	std::vector<float> X_c((size_t) N * D);
+	double total = 0;
+
+	for ( int q = 0; q < N; q++ ) {
+		for ( int i = 0; i < D; i++ ) {
+			float x = X.elem(i, q) - _mean[i];
+
+			X_c[(size_t) q * D + i] = x;
+			total += (double) x * x;
+		}
+	}
+
+	// form the covariance or Gram operator explicitly if that
+	// costs less than the products, which take about two passes
+	// per basis vector
+	const int MAX_DENSE = 8192;
+
+	bool gram = (N < D);
+	int n_op = gram ? N : D;
+	int num_products = 2 * std::max(2 * n1 + 1, n1 + 16);
+	bool dense = (n_op <= std::min(4 * num_products, MAX_DENSE));
+	std::vector<double> C;
+
+	if ( dense && gram ) {
+		std::vector<float> X_t((size_t) D * N);
+
+		for ( int q = 0; q < N; q++ ) {
+			for ( int i = 0; i < D; i++ ) {
+				X_t[(size_t) i * N + q] = X_c[(size_t) q * D + i];
+			}
+		}
+
+		C.assign((size_t) N * N, 0.0);
+		sym_rank_k(X_t.data(), D, N, C);
+		sym_fill_lower(C, N);
+	}
+	else if ( dense ) {
+		C.assign((size_t) D * D, 0.0);
+		sym_rank_k(X_c.data(), N, D, C);
+		sym_fill_lower(C, D);
+	}
+
+	// define the products with the operator
+	std::vector<double> t(D);
+
+	auto dense_matvec = [&] (const double *v, double *w) {
+		for ( int i = 0; i < n_op; i++ ) {
+			const double *C_i = &C[(size_t) i * n_op];
+			double s = 0;
+
+			for ( int j = 0; j < n_op; j++ ) {
+				s += C_i[j] * v[j];
+			}
+
+			w[i] = s;
+		}
+	};
+
+	auto cov_matvec = [&] (const double *v, double *w) {
+		std::fill(w, w + D, 0.0);
+
+		for ( int q = 0; q < N; q++ ) {
+			const float *x_q = &X_c[(size_t) q * D];
+			double s = 0;
+
+			for ( int i = 0; i < D; i++ ) {
+				s += x_q[i] * v[i];
+			}
+
+			for ( int i = 0; i < D; i++ ) {
+				w[i] += s * x_q[i];
+			}
+		}
+	};
+
+	auto gram_matvec = [&] (const double *u, double *w) {
+		std::fill(t.begin(), t.end(), 0.0);
+
+		for ( int q = 0; q < N; q++ ) {
+			const float *x_q = &X_c[(size_t) q * D];
+
+			for ( int i = 0; i < D; i++ ) {
+				t[i] += u[q] * x_q[i];
+			}
+		}
+
+		for ( int q = 0; q < N; q++ ) {
+			const float *x_q = &X_c[(size_t) q * D];
+			double s = 0;
+
+			for ( int i = 0; i < D; i++ ) {
+				s += x_q[i] * t[i];
+			}
+
+			w[q] = s;
+		}
+	};
+
+	// compute the top eigenvectors
+	std::vector<double> evecs;
+	std::vector<double> evals;
+
+	if ( dense ) {
+		n1 = solve(dense_matvec, n_op, n1, total, evecs, evals);
+	}
+	else if ( gram ) {
+		n1 = solve(gram_matvec, n_op, n1, total, evecs, evals);
+	}
+	else {
+		n1 = solve(cov_matvec, n_op, n1, total, evecs, evals);
+	}
+
+	// map the eigenvectors to eigenfaces
+	_W.assign((size_t) n1 * D, 0.0f);
+
+	for ( int k = 0; k < n1; k++ ) {
+		float *w_k = &_W[(size_t) k * D];
+
+		if ( !gram ) {
+			std::copy(&evecs[(size_t) k * D], &evecs[(size_t) (k + 1) * D], w_k);
+			continue;
+		}
+
+		if ( evals[k] <= 0 ) {
+			continue;
+		}
+
+		const double *u_k = &evecs[(size_t) k * N];
+		double scale = 1 / sqrt(evals[k]);
+
+		for ( int q = 0; q < N; q++ ) {
+			const float *x_q = &X_c[(size_t) q * D];
+
+			for ( int i = 0; i < D; i++ ) {
+				w_k[i] += scale * u_k[q] * x_q[i];
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	_solve_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Compute the eigenfaces of a sparse training set whose rows are
+ * shifted by an offset, such as the mean that the model subtracts
+ * from dense samples. The rows are centered implicitly in the
+ * products with the operator, so that the training set is never
+ * expanded, and the operator is never formed explicitly.
+ *
+ * @param X
+ * @param offset
+ */
+void LanczosPCALayer::compute(const csr_matrix_t& X, const std::vector<float>& offset)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int D = X.cols;
+	int N = X.rows;
+	int n1 = std::min(D, N - 1);
+
+	if ( _n1 > 0 ) {
+		n1 = std::min(_n1, n1);
+	}
+
+	// compute the mean of the rows, and the mean of the shifted rows
+	// which is subtracted when dense samples are projected
+	std::vector<double> mean(D, 0.0);
+
+	for ( int q = 0; q < N; q++ ) {
+		for ( int64_t k = X.row_ptr[q]; k < X.row_ptr[q + 1]; k++ ) {
+			mean[X.col_idx[k]] += X.values[k];
+		}
+	}
+
+	_mean.resize(D);
+
+	for ( int i = 0; i < D; i++ ) {
+		mean[i] /= N;
+		_mean[i] = mean[i] - offset[i];
+	}
+
+	// compute the total variance from ||x - m||^2 = ||x||^2 - 2 * x'm + ||m||^2
+	auto row_dot = [&X] (int q, const double *v) {
+		double s = 0;
+
+		for ( int64_t k = X.row_ptr[q]; k < X.row_ptr[q + 1]; k++ ) {
+			s += X.values[k] * v[X.col_idx[k]];
+		}
+
+		return s;
+	};
+
+	double mean_norm = 0;
+
+	for ( int i = 0; i < D; i++ ) {
+		mean_norm += mean[i] * mean[i];
+	}
+
+	double total = N * mean_norm;
+
+	for ( int q = 0; q < N; q++ ) {
+		for ( int64_t k = X.row_ptr[q]; k < X.row_ptr[q + 1]; k++ ) {
+			total += (double) X.values[k] * X.values[k];
+		}
+
+		total -= 2 * row_dot(q, mean.data());
+	}
+
+	// define the products with the operator, centering each
+	// row x as x - m
+	bool gram = (N < D);
+	int n_op = gram ? N : D;
+	std::vector<double> t(D);
+
+	auto dot = [D] (const double *a, const double *b) {
+		double s = 0;
+
+		for ( int i = 0; i < D; i++ ) {
+			s += a[i] * b[i];
+		}
+
+		return s;
+	};
+
+	auto cov_matvec = [&] (const double *v, double *w) {
+		double m_v = dot(mean.data(), v);
+		double s_sum = 0;
+
+		std::fill(w, w + D, 0.0);
+
+		for ( int q = 0; q < N; q++ ) {
+			double s = row_dot(q, v) - m_v;
+
+			for ( int64_t k = X.row_ptr[q]; k < X.row_ptr[q + 1]; k++ ) {
+				w[X.col_idx[k]] += s * X.values[k];
+			}
+
+			s_sum += s;
+		}
+
+		for ( int i = 0; i < D; i++ ) {
+			w[i] -= s_sum * mean[i];
+		}
+	};
+
+	auto gram_matvec = [&] (const double *u, double *w) {
+		double u_sum = 0;
+
+		std::fill(t.begin(), t.end(), 0.0);
+
+		for ( int q = 0; q < N; q++ ) {
+			for ( int64_t k = X.row_ptr[q]; k < X.row_ptr[q + 1]; k++ ) {
+				t[X.col_idx[k]] += u[q] * X.values[k];
+			}
+
+			u_sum += u[q];
+		}
+
+		for ( int i = 0; i < D; i++ ) {
+			t[i] -= u_sum * mean[i];
+		}
+
+		double m_t = dot(mean.data(), t.data());
+
+		for ( int q = 0; q < N; q++ ) {
+			w[q] = row_dot(q, t.data()) - m_t;
+		}
+	};
+
+	// compute the top eigenvectors
+	std::vector<double> evecs;
+	std::vector<double> evals;
+
+	if ( gram ) {
+		n1 = solve(gram_matvec, n_op, n1, total, evecs, evals);
+	}
+	else {
+		n1 = solve(cov_matvec, n_op, n1, total, evecs, evals);
+	}
+
+	// map the eigenvectors to eigenfaces
+	_W.assign((size_t) n1 * D, 0.0f);
+
+	for ( int k = 0; k < n1; k++ ) {
+		float *w_k = &_W[(size_t) k * D];
+
+		if ( !gram ) {
+			std::copy(&evecs[(size_t) k * D], &evecs[(size_t) (k + 1) * D], w_k);
+			continue;
+		}
+
+		if ( evals[k] <= 0 ) {
+			continue;
+		}
+
+		const double *u_k = &evecs[(size_t) k * N];
+		double scale = 1 / sqrt(evals[k]);
+		double u_sum = 0;
+
+		std::fill(t.begin(), t.end(), 0.0);
+
+		for ( int q = 0; q < N; q++ ) {
+			for ( int64_t j = X.row_ptr[q]; j < X.row_ptr[q + 1]; j++ ) {
+				t[X.col_idx[j]] += u_k[q] * X.values[j];
+			}
+
+			u_sum += u_k[q];
+		}
+
+		for ( int i = 0; i < D; i++ ) {
+			w_k[i] = scale * (t[i] - u_sum * mean[i]);
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	_solve_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Project a matrix onto the eigenfaces.
+ *
+ * @param X
+ */
+Matrix LanczosPCALayer::project(const Matrix& X)
+{
+	int D = _mean.size();
+	int n1 = _W.size() / D;
+	Matrix P(n1, X.cols());
+	std::vector<float> x(D);
+
+	for ( int q = 0; q < X.cols(); q++ ) {
+		for ( int i = 0; i < D; i++ ) {
+			x[i] = X.elem(i, q) - _mean[i];
+		}
+
+		for ( int k = 0; k < n1; k++ ) {
+			const float *w_k = &_W[(size_t) k * D];
+			float sum = 0;
+
+			for ( int i = 0; i < D; i++ ) {
+				sum += w_k[i] * x[i];
+			}
+
+			P.elem(k, q) = sum;
+		}
+	}
+
+	return P;
+}
+
+
+
+/**
+ * Project a sparse matrix whose rows are shifted by an offset
+ * onto the eigenfaces. Since w'(x - offset - mean) is computed
+ * as w'x - w'(offset + mean), the rows are never expanded.
+ *
+ * @param X
+ * @param offset
+ */
+Matrix LanczosPCALayer::project(const csr_matrix_t& X, const std::vector<float>& offset)
+{
+	int D = _mean.size();
+	int n1 = _W.size() / D;
+	Matrix P(n1, X.rows);
+	std::vector<float> shift(n1, 0.0f);
+
+	for ( int k = 0; k < n1; k++ ) {
+		const float *w_k = &_W[(size_t) k * D];
+
+		for ( int i = 0; i < D; i++ ) {
+			shift[k] += w_k[i] * (offset[i] + _mean[i]);
+		}
+	}
+
+	for ( int q = 0; q < X.rows; q++ ) {
+		for ( int k = 0; k < n1; k++ ) {
+			const float *w_k = &_W[(size_t) k * D];
+			float sum = -shift[k];
+
+			for ( int64_t j = X.row_ptr[q]; j < X.row_ptr[q + 1]; j++ ) {
+				sum += w_k[X.col_idx[j]] * X.values[j];
+			}
+
+			P.elem(k, q) = sum;
+		}
+	}
+
+	return P;
+}
+
+
+
+/**
+ * Save a Lanczos PCA layer to a file.
+ *
+ * @param file
+ */
+void LanczosPCALayer::save(std::ofstream& file)
+{
+	int D = _mean.size();
+	int n1 = _W.size() / D;
+
+	file.write(reinterpret_cast<const char *>(&D), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&n1), sizeof(int));
+
+	file.write(reinterpret_cast<const char *>(_mean.data()), _mean.size() * sizeof(float));
+	file.write(reinterpret_cast<const char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Load a Lanczos PCA layer from a file.
+ *
+ * @param file
+ */
+void LanczosPCALayer::load(std::ifstream& file)
+{
+	int D;
+	int n1;
+
+	file.read(reinterpret_cast<char *>(&D), sizeof(int));
+	file.read(reinterpret_cast<char *>(&n1), sizeof(int));
+
+	_mean.resize(D);
+	_W.resize((size_t) n1 * D);
+
+	file.read(reinterpret_cast<char *>(_mean.data()), _mean.size() * sizeof(float));
+	file.read(reinterpret_cast<char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Truncate a Lanczos PCA layer to its first n eigenfaces.
+ *
+ * @param n
+ */
+void LanczosPCALayer::truncate(int n)
+{
+	int D = _mean.size();
+	int n1 = std::min(n, (int) (_W.size() / D));
+
+	_n1 = n1;
+	_W.resize((size_t) n1 * D);
+}
+
+
+
+/**
+ * Print information about a Lanczos PCA layer.
+ */
+void LanczosPCALayer::print()
+{
+	log(LogLevel::Verbose, "PCA (Lanczos)");
+	log(LogLevel::Verbose, "  %-20s  %10d", "n1", _n1);
+	log(LogLevel::Verbose, "  %-20s  %10f", "energy", _energy);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print solver statistics.
+ */
+void LanczosPCALayer::print_stats()
+{
+	if ( _num_matvecs == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "lanczos: %d matrix-vector products, %d restarts, %.3f s",
+		_num_matvecs,
+		_num_restarts,
+		_solve_time);
+	log(LogLevel::Info, "pca: %d components, %.1f%% of the variance",
+		(int) (_W.size() / _mean.size()),
+		100 * _explained);
+}
+
+
+
+/**
+ * Create the PCA layer of an eigensolver. An energy target
+ * always uses the Lanczos layer, since the PCA layer does
+ * not expose its eigenvalues.
+ *
+ * @param solver
+ * @param n1
+ * @param energy
+ */
+FeatureLayer * create_pca(EigenSolver solver, int n1, float energy)
+{
+	if ( solver == EigenSolver::Lanczos || energy > 0 ) {
+		return new LanczosPCALayer(n1, energy);
+	}
+
+	return new PCALayer(n1);
+}
@@ -0,0 +1,62 @@
+/**
+ * @file lanczospcalayer.h
+ *
+ * Interface definitions for the Lanczos PCA feature layer.
+ */
+#ifndef LANCZOSPCALAYER_H
+#define LANCZOSPCALAYER_H
+
+#include <fstream>
+#include <mlearn.h>
+#include <vector>
+#include "csrmatrix.h"
+#include "lanczos.h"
+
+
+
+enum class EigenSolver {
+	None,
+	Full,
+	Lanczos
+};
+
+
+
+class LanczosPCALayer : public ML::FeatureLayer {
+private:
+	int _n1;
+	float _energy;
+	float _explained;
+
+	std::vector<float> _mean;
+	std::vector<float> _W;
+
+	int _num_matvecs;
+	int _num_restarts;
+	float _solve_time;
+
+	int solve(const matvec_func_t& matvec, int n_op, int n1, double total, std::vector<double>& evecs, std::vector<double>& evals);
+
+public:
+	LanczosPCALayer(int n1, float energy);
+	~LanczosPCALayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	void compute(const csr_matrix_t& X, const std::vector<float>& offset);
+	ML::Matrix project(const ML::Matrix& X);
+	ML::Matrix project(const csr_matrix_t& X, const std::vector<float>& offset);
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+	void truncate(int n);
+
+	void print();
+	void print_stats();
+};
+
+
+
+ML::FeatureLayer * create_pca(EigenSolver solver, int n1, float energy);
+
+
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * @file lbplayer.cpp
+ *
+ * Implementation of the LBP histogram feature layer.
+ *
+ * The layer describes a face by its local binary patterns (Ahonen et
+ * al., 2006): each pixel is encoded by comparing it with its eight
+ * neighbors, the codes are reduced to the 58 uniform patterns plus
+ * one bin for all other patterns, and a histogram of the codes is
+ * computed for each cell of a grid over the face. The histograms are
+ * normalized and concatenated, so the descriptor is meant to be
+ * compared with the chi-square distance. There is nothing to fit, so
+ * new identities can be enrolled without retraining.
+ *
+ * Codes are computed one image row at a time from three adjacent rows
+ * of the packed face, with a branch-free inner loop over the row
+ * which maps directly onto SIMD registers.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "bboxiterator.h"
+#include "lbplayer.h"
+
+
+
+using namespace ML;
+
+
+
+const int NUM_BINS = 59;
+
+
+
+/**
+ * Build the map from 8-bit LBP codes to histogram bins. Each
+ * uniform pattern, which has at most two circular transitions
+ * between 0 and 1, has its own bin, and all other patterns
+ * share the last bin.
+ */
+std::vector<unsigned char> uniform_bins()
+{
+	std::vector<unsigned char> bins(256);
+	int next = 0;
+
+	for ( int code = 0; code < 256; code++ ) {
+		int rotated = ((code << 1) | (code >> 7)) & 0xFF;
+		int transitions = __builtin_popcount(code ^ rotated);
+
+		bins[code] = (transitions <= 2)
+			? next++
+			: NUM_BINS - 1;
+	}
+
+	return bins;
+}
+
+
+
+/**
+ * Construct an LBP layer. If the width and height are zero,
+ * the images are assumed to be square.
+ *
+ * @param grid
+ * @param width
+ * @param height
+ */
+LBPLayer::LBPLayer(int grid, int width, int height)
+{
+	_grid = grid;
+	_width = width;
+	_height = height;
+	_channels = 0;
+
+	_num_faces = 0;
+	_project_time = 0;
+}
+
+
+
+/**
+ * Determine the image shape of the training set. There is
+ * nothing to fit.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void LBPLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	if ( !image_shape(X.rows(), _width, _height, _channels) ) {
+		std::cerr << "error: samples of size " << X.rows() << " do not match the image shape of LBP, use --image_width and --image_height\n";
+		exit(1);
+	}
+}
+
+
+
+/**
+ * Convert a packed sample to a grayscale image.
+ *
+ * @param X
+ * @param q
+ * @param gray
+ */
+void LBPLayer::to_gray(const Matrix& X, int q, float *gray) const
+{
+	int num_pixels = _width * _height;
+
+	if ( _channels == 3 ) {
+		for ( int i = 0; i < num_pixels; i++ ) {
+			gray[i] = 0.299f * X.elem(3 * i, q)
+				+ 0.587f * X.elem(3 * i + 1, q)
+				+ 0.114f * X.elem(3 * i + 2, q);
+		}
+	}
+	else {
+		for ( int i = 0; i < num_pixels; i++ ) {
+			gray[i] = X.elem(i * _channels, q);
+		}
+	}
+}
+
+
+
+/**
+ * Compute the LBP histograms of a matrix of samples.
+ * Cell (i, j) of the grid is mapped to rows
+ * (i * grid + j) * 59 to (i * grid + j) * 59 + 58
+ * of the projection.
+ *
+ * @param X
+ */
+Matrix LBPLayer::project(const Matrix& X)
+{
+	static const std::vector<unsigned char> BINS = uniform_bins();
+
+	auto start = std::chrono::steady_clock::now();
+
+	int w = _width;
+	int h = _height;
+	int num_cells = _grid * _grid;
+	Matrix P(num_cells * NUM_BINS, X.cols());
+
+	// assign each interior pixel to a cell
+	std::vector<int> cell_col(w);
+	std::vector<int> cell_row(h);
+	std::vector<int> counts(num_cells, 0);
+
+	for ( int x = 0; x < w; x++ ) {
+		cell_col[x] = x * _grid / w;
+	}
+
+	for ( int r = 0; r < h; r++ ) {
+		cell_row[r] = r * _grid / h;
+	}
+
+	for ( int r = 1; r < h - 1; r++ ) {
+		for ( int x = 1; x < w - 1; x++ ) {
+			counts[cell_row[r] * _grid + cell_col[x]]++;
+		}
+	}
+
+	std::vector<float> gray((size_t) w * h);
+	std::vector<unsigned char> codes(w);
+	std::vector<float> hist(num_cells * NUM_BINS);
+
+	for ( int q = 0; q < X.cols(); q++ ) {
+		to_gray(X, q, gray.data());
+
+		std::fill(hist.begin(), hist.end(), 0.0f);
+
+		for ( int r = 1; r < h - 1; r++ ) {
+			const float *up = &gray[(size_t) (r - 1) * w];
+			const float *mid = &gray[(size_t) r * w];
+			const float *down = &gray[(size_t) (r + 1) * w];
+
+			// encode the row
+			for ( int x = 1; x < w - 1; x++ ) {
+				float c = mid[x];
+
+				codes[x] = (up[x - 1] >= c)
+					| (up[x] >= c) << 1
+					| (up[x + 1] >= c) << 2
+					| (mid[x + 1] >= c) << 3
+					| (down[x + 1] >= c) << 4
+					| (down[x] >= c) << 5
+					| (down[x - 1] >= c) << 6
+					| (mid[x - 1] >= c) << 7;
+			}
+
+			// add the row to the histograms of its cells
+			float *hist_r = &hist[cell_row[r] * _grid * NUM_BINS];
+
+			for ( int x = 1; x < w - 1; x++ ) {
+				hist_r[cell_col[x] * NUM_BINS + BINS[codes[x]]] += 1;
+			}
+		}
+
+		// normalize each histogram by the size of its cell
+		for ( int k = 0; k < num_cells; k++ ) {
+			float scale = (counts[k] > 0) ? 1.0f / counts[k] : 0;
+
+			for ( int b = 0; b < NUM_BINS; b++ ) {
+				P.elem(k * NUM_BINS + b, q) = scale * hist[k * NUM_BINS + b];
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	_num_faces += X.cols();
+	_project_time += std::chrono::duration<float>(end - start).count();
+
+	return P;
+}
+
+
+
+/**
+ * Save an LBP layer to a file.
+ *
+ * @param file
+ */
+void LBPLayer::save(std::ofstream& file)
+{
+	file.write(reinterpret_cast<const char *>(&_grid), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_width), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_height), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_channels), sizeof(int));
+}
+
+
+
+/**
+ * Load an LBP layer from a file.
+ *
+ * @param file
+ */
+void LBPLayer::load(std::ifstream& file)
+{
+	file.read(reinterpret_cast<char *>(&_grid), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_width), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_height), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_channels), sizeof(int));
+}
+
+
+
+/**
+ * Print information about an LBP layer.
+ */
+void LBPLayer::print()
+{
+	log(LogLevel::Verbose, "LBP");
+	log(LogLevel::Verbose, "  %-20s  %10d", "grid", _grid);
+	log(LogLevel::Verbose, "  %-20s  %10d", "width", _width);
+	log(LogLevel::Verbose, "  %-20s  %10d", "height", _height);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print the cost of computing the descriptor of a face.
+ */
+void LBPLayer::print_stats()
+{
+	if ( _num_faces == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "lbp: %ld faces, %.3f ms per face",
+		_num_faces,
+		1000 * _project_time / _num_faces);
+}
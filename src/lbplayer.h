@@ -0,0 +1,45 @@
+/**
+ * @file lbplayer.h
+ *
+ * Interface definitions for the LBP histogram feature layer.
+ */
+#ifndef LBPLAYER_H
+#define LBPLAYER_H
+
+#include <fstream>
+#include <mlearn.h>
+#include <vector>
+
+
+
+class LBPLayer : public ML::FeatureLayer {
+private:
+	int _grid;
+	int _width;
+	int _height;
+	int _channels;
+
+	long _num_faces;
+	float _project_time;
+
+	void to_gray(const ML::Matrix& X, int q, float *gray) const;
+
+public:
+	LBPLayer(int grid, int width, int height);
+	~LBPLayer() {};
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,556 @@
+/**
+ * @file linalg.cpp
+ *
+ * Implementation of dense linear algebra routines.
+ *
+ * Matrices are stored in row-major order as n x n arrays of
+ * doubles. The Cholesky and triangular routines only reference
+ * the lower triangle, while the eigensolver requires the full
+ * symmetric matrix. The rank-k update only references the upper
+ * triangle.
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <utility>
+#include "linalg.h"
+
+
+
+/**
+ * Number of threads used by the rank-k update (0 = all cores).
+ */
+int LINALG_THREADS = 0;
+
+
+
+/**
+ * Compute the Cholesky factorization A = L * L' of a symmetric
+ * positive-definite matrix in place. On return the lower triangle
+ * of A contains L and the strict upper triangle is zero.
+ *
+ * Returns false if the matrix is not positive definite.
+ *
+ * @param A
+ * @param n
+ */
+bool cholesky(std::vector<double>& A, int n)
+{
+	for ( int j = 0; j < n; j++ ) {
+		double *A_j = &A[(size_t) j * n];
+		double sum = A_j[j];
+
+		for ( int k = 0; k < j; k++ ) {
+			sum -= A_j[k] * A_j[k];
+		}
+
+		if ( sum <= 0 ) {
+			return false;
+		}
+
+		A_j[j] = sqrt(sum);
+
+		for ( int i = j + 1; i < n; i++ ) {
+			double *A_i = &A[(size_t) i * n];
+			double sum = A_i[j];
+
+			for ( int k = 0; k < j; k++ ) {
+				sum -= A_i[k] * A_j[k];
+			}
+
+			A_i[j] = sum / A_j[j];
+		}
+
+		for ( int k = j + 1; k < n; k++ ) {
+			A_j[k] = 0;
+		}
+	}
+
+	return true;
+}
+
+
+
+/**
+ * Compute the inverse of a lower-triangular matrix in place.
+ *
+ * @param L
+ * @param n
+ */
+void tri_inverse(std::vector<double>& L, int n)
+{
+	for ( int j = 0; j < n; j++ ) {
+		L[(size_t) j * n + j] = 1 / L[(size_t) j * n + j];
+
+		for ( int i = j + 1; i < n; i++ ) {
+			double sum = 0;
+
+			for ( int k = j; k < i; k++ ) {
+				sum -= L[(size_t) i * n + k] * L[(size_t) k * n + j];
+			}
+
+			L[(size_t) i * n + j] = sum / L[(size_t) i * n + i];
+		}
+	}
+}
+
+
+
+/**
+ * Reduce a symmetric matrix to tridiagonal form with Householder
+ * transformations. On return V contains the accumulated orthogonal
+ * transformation, d contains the diagonal and e contains the
+ * subdiagonal in e[1..n-1].
+ *
+ * Based on the tred2 routine from EISPACK.
+ *
+ * @param V
+ * @param n
+ * @param d
+ * @param e
+ */
+void tred2(std::vector<double>& V, int n, std::vector<double>& d, std::vector<double>& e)
+{
+	auto v = [&V, n] (int i, int j) -> double& { return V[(size_t) i * n + j]; };
+
+	for ( int j = 0; j < n; j++ ) {
+		d[j] = v(n - 1, j);
+	}
+
+	for ( int i = n - 1; i > 0; i-- ) {
+		double scale = 0;
+		double h = 0;
+
+		for ( int k = 0; k < i; k++ ) {
+			scale += fabs(d[k]);
+		}
+
+		if ( scale == 0 ) {
+			e[i] = d[i - 1];
+
+			for ( int j = 0; j < i; j++ ) {
+				d[j] = v(i - 1, j);
+				v(i, j) = 0;
+				v(j, i) = 0;
+			}
+		}
+		else {
+			for ( int k = 0; k < i; k++ ) {
+				d[k] /= scale;
+				h += d[k] * d[k];
+			}
+
+			double f = d[i - 1];
+			double g = (f > 0) ? -sqrt(h) : sqrt(h);
+
+			e[i] = scale * g;
+			h -= f * g;
+			d[i - 1] = f - g;
+
+			for ( int j = 0; j < i; j++ ) {
+				e[j] = 0;
+			}
+
+			for ( int j = 0; j < i; j++ ) {
+				f = d[j];
+				v(j, i) = f;
+				g = e[j] + v(j, j) * f;
+
+				for ( int k = j + 1; k <= i - 1; k++ ) {
+					g += v(k, j) * d[k];
+					e[k] += v(k, j) * f;
+				}
+
+				e[j] = g;
+			}
+
+			f = 0;
+
+			for ( int j = 0; j < i; j++ ) {
+				e[j] /= h;
+				f += e[j] * d[j];
+			}
+
+			double hh = f / (h + h);
+
+			for ( int j = 0; j < i; j++ ) {
+				e[j] -= hh * d[j];
+			}
+
+			for ( int j = 0; j < i; j++ ) {
+				f = d[j];
+				g = e[j];
+
+				for ( int k = j; k <= i - 1; k++ ) {
+					v(k, j) -= (f * e[k] + g * d[k]);
+				}
+
+				d[j] = v(i - 1, j);
+				v(i, j) = 0;
+			}
+		}
+
+		d[i] = h;
+	}
+
+	// accumulate transformations
+	for ( int i = 0; i < n - 1; i++ ) {
+		v(n - 1, i) = v(i, i);
+		v(i, i) = 1;
+
+		double h = d[i + 1];
+
+		if ( h != 0 ) {
+			for ( int k = 0; k <= i; k++ ) {
+				d[k] = v(k, i + 1) / h;
+			}
+
+			for ( int j = 0; j <= i; j++ ) {
+				double g = 0;
+
+				for ( int k = 0; k <= i; k++ ) {
+					g += v(k, i + 1) * v(k, j);
+				}
+
+				for ( int k = 0; k <= i; k++ ) {
+					v(k, j) -= g * d[k];
+				}
+			}
+		}
+
+		for ( int k = 0; k <= i; k++ ) {
+			v(k, i + 1) = 0;
+		}
+	}
+
+	for ( int j = 0; j < n; j++ ) {
+		d[j] = v(n - 1, j);
+		v(n - 1, j) = 0;
+	}
+
+	v(n - 1, n - 1) = 1;
+	e[0] = 0;
+}
+
+
+
+/**
+ * Compute the eigenvalues and eigenvectors of a symmetric
+ * tridiagonal matrix with the implicit QL method. On entry V
+ * contains the transformation from tred2 (or the identity),
+ * d contains the diagonal and e contains the subdiagonal in
+ * e[1..n-1]. On return d contains the eigenvalues and the
+ * columns of V contain the eigenvectors.
+ *
+ * Based on the tql2 routine from EISPACK.
+ *
+ * @param V
+ * @param n
+ * @param d
+ * @param e
+ */
+void tql2(std::vector<double>& V, int n, std::vector<double>& d, std::vector<double>& e)
+{
+	auto v = [&V, n] (int i, int j) -> double& { return V[(size_t) i * n + j]; };
+
+	for ( int i = 1; i < n; i++ ) {
+		e[i - 1] = e[i];
+	}
+	e[n - 1] = 0;
+
+	const double EPS = std::numeric_limits<double>::epsilon();
+	double f = 0;
+	double tst1 = 0;
+
+	for ( int l = 0; l < n; l++ ) {
+		// find small subdiagonal element
+		tst1 = std::max(tst1, fabs(d[l]) + fabs(e[l]));
+
+		int m = l;
+		while ( m < n - 1 && fabs(e[m]) > EPS * tst1 ) {
+			m++;
+		}
+
+		// iterate until the eigenvalue converges
+		if ( m > l ) {
+			do {
+				double g = d[l];
+				double p = (d[l + 1] - g) / (2 * e[l]);
+				double r = hypot(p, 1.0);
+
+				if ( p < 0 ) {
+					r = -r;
+				}
+
+				d[l] = e[l] / (p + r);
+				d[l + 1] = e[l] * (p + r);
+
+				double dl1 = d[l + 1];
+				double h = g - d[l];
+
+				for ( int i = l + 2; i < n; i++ ) {
+					d[i] -= h;
+				}
+				f += h;
+
+				// implicit QL transformation
+				p = d[m];
+
+				double c = 1;
+				double c2 = c;
+				double c3 = c;
+				double el1 = e[l + 1];
+				double s = 0;
+				double s2 = 0;
+
+				for ( int i = m - 1; i >= l; i-- ) {
+					c3 = c2;
+					c2 = c;
+					s2 = s;
+					g = c * e[i];
+					h = c * p;
+					r = hypot(p, e[i]);
+					e[i + 1] = s * r;
+					s = e[i] / r;
+					c = p / r;
+					p = c * d[i] - s * g;
+					d[i + 1] = h + s * (c * g + s * d[i]);
+
+					for ( int k = 0; k < n; k++ ) {
+						h = v(k, i + 1);
+						v(k, i + 1) = s * v(k, i) + c * h;
+						v(k, i) = c * v(k, i) - s * h;
+					}
+				}
+
+				p = -s * s2 * c3 * el1 * e[l] / dl1;
+				e[l] = s * p;
+				d[l] = c * p;
+			} while ( fabs(e[l]) > EPS * tst1 );
+		}
+
+		d[l] += f;
+		e[l] = 0;
+	}
+}
+
+
+
+/**
+ * Compute the eigendecomposition of a symmetric matrix in place.
+ * On return the columns of A contain the eigenvectors and evals
+ * contains the eigenvalues, both in order of decreasing eigenvalue.
+ *
+ * @param A
+ * @param n
+ * @param evals
+ */
+void sym_eigen(std::vector<double>& A, int n, std::vector<double>& evals)
+{
+	std::vector<double> e(n);
+
+	evals.resize(n);
+
+	tred2(A, n, evals, e);
+	tql2(A, n, evals, e);
+
+	// sort eigenpairs by decreasing eigenvalue
+	for ( int i = 0; i < n - 1; i++ ) {
+		int k = i;
+
+		for ( int j = i + 1; j < n; j++ ) {
+			if ( evals[j] > evals[k] ) {
+				k = j;
+			}
+		}
+
+		if ( k != i ) {
+			std::swap(evals[i], evals[k]);
+
+			for ( int j = 0; j < n; j++ ) {
+				std::swap(A[(size_t) j * n + i], A[(size_t) j * n + k]);
+			}
+		}
+	}
+}
+
+
+
+/**
+ * Add the products of a block of samples to one tile of the upper
+ * triangle of C. The samples are taken four at a time so that each
+ * element of the tile is loaded and stored once per four samples.
+ *
+ * @param X
+ * @param q0
+ * @param q1
+ * @param d
+ * @param i0
+ * @param i1
+ * @param j0
+ * @param j1
+ * @param C
+ */
+void rank_k_tile(const float *X, int q0, int q1, int d, int i0, int i1, int j0, int j1, double *C)
+{
+	int q = q0;
+
+	for ( ; q + 4 <= q1; q += 4 ) {
+		const float *x0 = &X[(size_t) q * d];
+		const float *x1 = x0 + d;
+		const float *x2 = x1 + d;
+		const float *x3 = x2 + d;
+
+		for ( int i = i0; i < i1; i += 2 ) {
+			double a0 = x0[i];
+			double a1 = x1[i];
+			double a2 = x2[i];
+			double a3 = x3[i];
+			double *C_i = &C[(size_t) i * d];
+			int j = std::max(i, j0);
+
+			// update a single row at the end of the tile
+			if ( i + 1 == i1 ) {
+				for ( ; j < j1; j++ ) {
+					C_i[j] += a0 * x0[j] + a1 * x1[j] + a2 * x2[j] + a3 * x3[j];
+				}
+				break;
+			}
+
+			// update two rows at a time otherwise, so that each
+			// sample value is loaded once for both rows
+			double b0 = x0[i + 1];
+			double b1 = x1[i + 1];
+			double b2 = x2[i + 1];
+			double b3 = x3[i + 1];
+			double *C_i1 = C_i + d;
+
+			if ( j == i ) {
+				C_i[j] += a0 * x0[j] + a1 * x1[j] + a2 * x2[j] + a3 * x3[j];
+				j++;
+			}
+
+			for ( ; j < j1; j++ ) {
+				double y0 = x0[j];
+				double y1 = x1[j];
+				double y2 = x2[j];
+				double y3 = x3[j];
+
+				C_i[j] += a0 * y0 + a1 * y1 + a2 * y2 + a3 * y3;
+				C_i1[j] += b0 * y0 + b1 * y1 + b2 * y2 + b3 * y3;
+			}
+		}
+	}
+
+	for ( ; q < q1; q++ ) {
+		const float *x = &X[(size_t) q * d];
+
+		for ( int i = i0; i < i1; i++ ) {
+			double a = x[i];
+			double *C_i = &C[(size_t) i * d];
+
+			for ( int j = std::max(i, j0); j < j1; j++ ) {
+				C_i[j] += a * x[j];
+			}
+		}
+	}
+}
+
+
+
+/**
+ * Compute the symmetric rank-k update C += X' * X, where X is an
+ * n x d matrix of samples stored one sample after another and C
+ * is a d x d matrix. Only the upper triangle of C is referenced.
+ *
+ * The upper triangle is divided into square tiles which are
+ * distributed over LINALG_THREADS threads, so that every element
+ * of C is owned by exactly one thread. Each thread walks over
+ * the samples in panels and updates all of its tiles from a panel
+ * before moving on to the next one. The threads move through the
+ * samples at about the same pace, so each panel is read from
+ * memory once and then shared through the cache.
+ *
+ * @param X
+ * @param n
+ * @param d
+ * @param C
+ */
+void sym_rank_k(const float *X, int n, int d, std::vector<double>& C)
+{
+	const int PANEL = 128;
+	const double MIN_WORK_PER_THREAD = 1 << 22;
+
+	// use only as many threads as there is work for
+	int num_threads = (LINALG_THREADS > 0)
+		? LINALG_THREADS
+		: std::max(1u, std::thread::hardware_concurrency());
+	double work = 0.5 * n * d * d;
+
+	num_threads = std::min(num_threads, std::max(1, (int) (work / MIN_WORK_PER_THREAD)));
+
+	// use smaller tiles if there are not enough tiles for the threads
+	int block = 64;
+
+	while ( block > 16 && (d + block - 1) / block * ((d + block - 1) / block + 1) / 2 < 2 * num_threads ) {
+		block /= 2;
+	}
+
+	// enumerate the tiles of the upper triangle
+	std::vector<std::pair<int, int>> tiles;
+
+	for ( int i0 = 0; i0 < d; i0 += block ) {
+		for ( int j0 = i0; j0 < d; j0 += block ) {
+			tiles.push_back(std::make_pair(i0, j0));
+		}
+	}
+
+	num_threads = std::min(num_threads, (int) tiles.size());
+
+	auto update = [&] (int t) {
+		for ( int q0 = 0; q0 < n; q0 += PANEL ) {
+			int q1 = std::min(q0 + PANEL, n);
+
+			for ( size_t k = t; k < tiles.size(); k += num_threads ) {
+				int i0 = tiles[k].first;
+				int j0 = tiles[k].second;
+
+				rank_k_tile(X, q0, q1, d, i0, std::min(i0 + block, d), j0, std::min(j0 + block, d), C.data());
+			}
+		}
+	};
+
+	if ( num_threads == 1 ) {
+		update(0);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+
+	for ( int t = 0; t < num_threads; t++ ) {
+		threads.emplace_back(update, t);
+	}
+
+	for ( std::thread& thread : threads ) {
+		thread.join();
+	}
+}
+
+
+
+/**
+ * Copy the upper triangle of a symmetric matrix to its
+ * lower triangle.
+ *
+ * @param C
+ * @param d
+ */
+void sym_fill_lower(std::vector<double>& C, int d)
+{
+	for ( int i = 0; i < d; i++ ) {
+		for ( int j = 0; j < i; j++ ) {
+			C[(size_t) i * d + j] = C[(size_t) j * d + i];
+		}
+	}
+}
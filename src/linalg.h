@@ -0,0 +1,26 @@
+/**
+ * @file linalg.h
+ *
+ * Interface definitions for dense linear algebra routines
+ * on row-major symmetric and triangular matrices.
+ */
+#ifndef LINALG_H
+#define LINALG_H
+
+#include <vector>
+
+
+
+bool cholesky(std::vector<double>& A, int n);
+void tri_inverse(std::vector<double>& L, int n);
+void sym_eigen(std::vector<double>& A, int n, std::vector<double>& evals);
+void sym_rank_k(const float *X, int n, int d, std::vector<double>& C);
+void sym_fill_lower(std::vector<double>& C, int d);
+
+
+
+extern int LINALG_THREADS;
+
+
+
+#endif
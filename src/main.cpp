@@ -3,7 +3,13 @@
  *
  * User interface to the face recognition system.
  */
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <atomic>
 #include <cstdlib>
+#include <ctime>
+#include <dirent.h>
 #include <exception>
 #include <getopt.h>
 #include <iomanip>
@@ -15,8 +21,33 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
+#include <sstream>
+#include <thread>
 #include <unistd.h>
+#include "batchbayeslayer.h"
 #include "bboxiterator.h"
+#include "cachedfeaturelayer.h"
+#include "cascadelayer.h"
+#include "checkpointicalayer.h"
+#include "detectionlog.h"
+#include "eventsink.h"
+#include "facetracker.h"
+#include "frozenfeaturelayer.h"
+#include "gallerylayer.h"
+#include "genomematrixiterator.h"
+#include "gridlayer.h"
+#include "lanczospcalayer.h"
+#include "lbplayer.h"
+#include "linalg.h"
+#include "matchcache.h"
+#include "motiondetector.h"
+#include "pca2dlayer.h"
+#include "qoscontroller.h"
+#include "randomprojectionlayer.h"
+#include "scanjournal.h"
+#include "streamldalayer.h"
+#include "videowriter.h"
+#include "workqueue.h"
 
 
 
@@ -27,6 +58,7 @@ using namespace ML;
 enum class DataType {
 	None,
 	Genome,
+	GenomeBinary,
 	Image
 };
 
@@ -37,7 +69,10 @@ enum class FeatureType {
 	Identity,
 	PCA,
 	LDA,
-	ICA
+	ICA,
+	RP,
+	PCA2D,
+	LBP
 };
 
 
@@ -45,30 +80,78 @@ enum class FeatureType {
 enum class ClassifierType {
 	None,
 	KNN,
-	Bayes
+	Bayes,
+	Cascade
 };
 
 
 
 typedef enum {
-	OPTION_GPU,
+	OPTION_GPU = 256,
 	OPTION_LOGLEVEL,
 	OPTION_TRAIN,
 	OPTION_TEST,
 	OPTION_STREAM,
+	OPTION_STREAM_FILE,
+	OPTION_STREAM_OUTPUT,
+	OPTION_WRITE_POLICY,
+	OPTION_RAW_RESULTS,
+	OPTION_EVENTS,
+	OPTION_RECORD,
+	OPTION_RECORD_CROPS,
+	OPTION_REPLAY,
+	OPTION_MOTION,
+	OPTION_TARGET_FPS,
+	OPTION_QUALITY_MIN,
+	OPTION_QUALITY_TOPK,
+	OPTION_HASH_TTL,
+	OPTION_HASH_RADIUS,
+	OPTION_SCAN,
+	OPTION_SCAN_OUTPUT,
+	OPTION_SCAN_THREADS,
+	OPTION_SCAN_OVERWRITE,
+	OPTION_RESUME,
+	OPTION_CACHE,
 	OPTION_DATA,
 	OPTION_FEATURE,
 	OPTION_CLASSIFIER,
+	OPTION_IMAGE_WIDTH,
+	OPTION_IMAGE_HEIGHT,
+	OPTION_SOLVER,
+	OPTION_THREADS,
+	OPTION_TRUNCATE,
 	OPTION_PCA_N1,
+	OPTION_PCA_ENERGY,
 	OPTION_LDA_N1,
 	OPTION_LDA_N2,
+	OPTION_LDA_BATCH,
+	OPTION_LDA_ENERGY,
 	OPTION_ICA_N1,
 	OPTION_ICA_N2,
 	OPTION_ICA_NONL,
 	OPTION_ICA_MAX_ITER,
 	OPTION_ICA_EPS,
+	OPTION_ICA_CHECKPOINT,
+	OPTION_ICA_ENERGY,
+	OPTION_RP_N,
+	OPTION_RP_SEED,
+	OPTION_PCA2D_N,
+	OPTION_LBP_GRID,
 	OPTION_KNN_K,
 	OPTION_KNN_DIST,
+	OPTION_KNN_CHUNK,
+	OPTION_KNN_LAYOUT,
+	OPTION_KNN_PREFILTER,
+	OPTION_KNN_CENTROIDS,
+	OPTION_BAYES_BATCH,
+	OPTION_BAYES_REG,
+	OPTION_CASCADE_COARSE,
+	OPTION_CASCADE_FINE,
+	OPTION_CASCADE_MARGIN,
+	OPTION_CASCADE_SHORTLIST,
+	OPTION_REJECT_THRESHOLD,
+	OPTION_GRID_FEAT,
+	OPTION_GRID_CLAS,
 	OPTION_UNKNOWN = '?'
 } option_t;
 
@@ -79,28 +162,76 @@ typedef struct {
 	bool test;
 	bool stream;
 	int stream_dev;
+	const char *path_stream;
+	const char *path_stream_output;
+	WritePolicy write_policy;
+	bool raw_results;
+	const char *path_events;
+	const char *path_record;
+	bool record_crops;
+	const char *path_replay;
+	int motion_interval;
+	float target_fps;
+	float quality_min;
+	int quality_topk;
+	int hash_ttl;
+	int hash_radius;
+	const char *path_scan;
+	const char *path_scan_output;
+	int scan_threads;
+	bool scan_overwrite;
+	bool resume;
+	const char *path_cache;
 	const char *path_train;
 	const char *path_test;
 	const char *path_model;
 	DataType data_type;
 	FeatureType feature_type;
 	ClassifierType classifier_type;
+	int image_width;
+	int image_height;
+	EigenSolver solver;
+	int threads;
+	int truncate;
 	int pca_n1;
+	float pca_energy;
 	int lda_n1;
 	int lda_n2;
+	int lda_batch;
+	float lda_energy;
 	int ica_n1;
 	int ica_n2;
 	ICANonl ica_nonl;
 	int ica_max_iter;
 	float ica_eps;
+	int ica_checkpoint;
+	float ica_energy;
+	int rp_n;
+	int rp_seed;
+	int pca2d_n;
+	int lbp_grid;
 	int knn_k;
-	KNNDist knn_dist;
+	MatchDist knn_dist;
+	int knn_chunk;
+	int knn_block;
+	int knn_prefilter;
+	int knn_centroids;
+	int bayes_batch;
+	float bayes_reg;
+	FeatureType cascade_coarse;
+	FeatureType cascade_fine;
+	float cascade_margin;
+	int cascade_shortlist;
+	float reject_threshold;
+	std::vector<FeatureType> grid_features;
+	std::vector<ClassifierType> grid_classifiers;
 } optarg_t;
 
 
 
 const std::map<std::string, DataType> data_types = {
 	{ "genome", DataType::Genome },
+	{ "genome_bin", DataType::GenomeBinary },
 	{ "image", DataType::Image }
 };
 
@@ -110,22 +241,49 @@ const std::map<std::string, FeatureType> feature_types = {
 	{ "identity", FeatureType::Identity },
 	{ "pca", FeatureType::PCA },
 	{ "lda", FeatureType::LDA },
-	{ "ica", FeatureType::ICA }
+	{ "ica", FeatureType::ICA },
+	{ "rp", FeatureType::RP },
+	{ "2dpca", FeatureType::PCA2D },
+	{ "lbp", FeatureType::LBP }
 };
 
 
 
 const std::map<std::string, ClassifierType> classifier_types = {
 	{ "knn", ClassifierType::KNN },
-	{ "bayes", ClassifierType::Bayes }
+	{ "bayes", ClassifierType::Bayes },
+	{ "cascade", ClassifierType::Cascade }
 };
 
 
 
-const std::map<std::string, KNNDist> dist_funcs = {
-	{ "COS", KNNDist::COS },
-	{ "L1", KNNDist::L1 },
-	{ "L2", KNNDist::L2 }
+const std::map<std::string, MatchDist> dist_funcs = {
+	{ "COS", MatchDist::COS },
+	{ "L1", MatchDist::L1 },
+	{ "L2", MatchDist::L2 },
+	{ "CHI2", MatchDist::CHI2 }
+};
+
+
+
+const std::map<std::string, EigenSolver> eigen_solvers = {
+	{ "full", EigenSolver::Full },
+	{ "lanczos", EigenSolver::Lanczos }
+};
+
+
+
+const std::map<std::string, int> knn_layouts = {
+	{ "column", 1 },
+	{ "block8", 8 },
+	{ "block16", 16 }
+};
+
+
+
+const std::map<std::string, WritePolicy> write_policies = {
+	{ "block", WritePolicy::Block },
+	{ "drop", WritePolicy::Drop }
 };
 
 
@@ -138,6 +296,47 @@ const std::map<std::string, ICANonl> nonl_funcs = {
 
 
 
+/**
+ * Split a string into a list of tokens.
+ *
+ * @param str
+ * @param delim
+ */
+std::vector<std::string> split(const std::string& str, char delim)
+{
+	std::vector<std::string> tokens;
+	std::stringstream stream(str);
+	std::string token;
+
+	while ( std::getline(stream, token, delim) ) {
+		tokens.push_back(token);
+	}
+
+	return tokens;
+}
+
+
+
+/**
+ * Get the name of a value in a name map.
+ *
+ * @param map
+ * @param value
+ */
+template<class T>
+std::string get_name(const std::map<std::string, T>& map, T value)
+{
+	for ( auto& entry : map ) {
+		if ( entry.second == value ) {
+			return entry.first;
+		}
+	}
+
+	return "";
+}
+
+
+
 /**
  * Print command-line usage and help text.
  */
@@ -152,17 +351,54 @@ void print_usage()
 		"  --train DIR        train a model with a training set\n"
 		"  --test DIR         perform recognition on a test set\n"
 		"  --stream           perform recognition in real time on a video stream\n"
-		"  --data             data type (genome, [image])\n"
-		"  --feat FEATURE     feature extraction layer ([identity], pca, lda, ica)\n"
-		"  --clas CLASSIFIER  classifier layer ([knn], bayes)\n"
+		"  --stream_file FILE read the video stream from a file instead of a camera\n"
+		"  --stream_output FILE write the annotated video stream to a file instead of a window\n"
+		"  --write_policy [policy] when the video writer falls behind ([block], drop)\n"
+		"  --raw_results      print faces and labels of each frame instead of drawing them\n"
+		"  --events PATH      write recognition events to a file, named pipe, or unix:SOCKET\n"
+		"  --record FILE      record the detected faces of each frame to a file\n"
+		"  --record_crops     include the face crops in the recording\n"
+		"  --replay FILE      classify recorded faces without detection, as fast as possible\n"
+		"  --motion N         detect faces only where there is motion, with a full scan every N frames ([0]=off)\n"
+		"  --target_fps X     adapt detection and classification to hold a target frame rate ([0]=off)\n"
+		"  --quality_min X    do not classify face crops with quality below X (0-1, [0]=off)\n"
+		"  --quality_topk K   classify only the K best crops of each tracked face ([0]=all)\n"
+		"  --hash_ttl N       reuse the result of a similar face crop for N frames ([0]=off)\n"
+		"  --hash_radius N    maximum Hamming distance between similar face crops ([4])\n"
+		"  --scan DIR         perform recognition on every image in a directory tree\n"
+		"  --scan_output FILE write scan results to a CSV file, resuming a previous scan ([scan.csv])\n"
+		"  --scan_threads N   number of decode and detection threads ([0]=all cores)\n"
+		"  --scan_overwrite   replace a scan output file which has no journal\n"
+		"  --resume           resume training from the last checkpoint\n"
+		"  --cache DIR        reuse fitted feature layers from a cache directory\n"
+		"  --data             data type (genome, genome_bin, [image])\n"
+		"  --image_width N    width of image samples for 2dpca and lbp ([0]=square images)\n"
+		"  --image_height N   height of image samples for 2dpca and lbp ([0]=square images)\n"
+		"  --feat FEATURE     feature extraction layer ([identity], pca, lda, ica, rp, 2dpca, lbp)\n"
+		"  --clas CLASSIFIER  classifier layer ([knn], bayes, cascade)\n"
+		"  --solver SOLVER    eigensolver of the PCA stage of pca, lda and ica ([full], lanczos)\n"
+		"  --threads N        number of threads for covariance and scatter matrices ([0]=all cores)\n"
+		"  --truncate N       truncate the feature layer of a saved model to N dimensions, using the training set of --train\n"
+		"  --reject_threshold X  reject faces whose match distance exceeds X as unknown (knn, batched bayes)\n"
+		"  --grid_feat LIST   evaluate a comma-separated list of feature layers\n"
+		"  --grid_clas LIST   evaluate a comma-separated list of classifier layers on each feature layer\n"
+		"                     (only knn and batched bayes run concurrently; the feature layers and\n"
+		"                     unbatched bayes run sequentially, since mlearn is not thread-safe)\n"
 		"\n"
 		"Hyperparameters:\n"
 		"PCA:\n"
 		"  --pca_n1 N         number of principal components to compute\n"
+		"  --pca_energy X     use the fewest components which explain a fraction X of the variance, up to pca_n1 ([0]=off)\n"
 		"\n"
 		"LDA:\n"
 		"  --lda_n1 N         number of principal components to compute\n"
 		"  --lda_n2 N         number of Fisherfaces to compute\n"
+		"  --lda_batch N      accumulate scatter matrices in batches of N samples ([0]=off);\n"
+		"                     with --data genome_bin the LDA layer is fitted from batches,\n"
+		"                     and a sparse matrix is never expanded (uses --solver lanczos);\n"
+		"                     peak memory is unchanged, since the model still loads the whole\n"
+		"                     training set to project it and fit the classifier\n"
+		"  --lda_energy X     use the fewest principal components which explain a fraction X of the variance, up to lda_n1 ([0]=off)\n"
 		"\n"
 		"ICA:\n"
 		"  --ica_n1 N         number of principal components to compute\n"
@@ -170,10 +406,37 @@ void print_usage()
 		"  --ica_nonl [nonl]  nonlinearity function to use ([pow3], tanh, gauss)\n"
 		"  --ica_max_iter N   maximum iterations\n"
 		"  --ica_eps X        convergence threshold for w\n"
+		"  --ica_checkpoint N write a checkpoint every N iterations ([0]=off)\n"
+		"  --ica_energy X     use the fewest principal components which explain a fraction X of the variance, up to ica_n1 ([0]=off)\n"
+		"\n"
+		"Random projection:\n"
+		"  --rp_n N           number of random projections ([100])\n"
+		"  --rp_seed N        seed of the projection matrix ([1])\n"
+		"\n"
+		"2D-PCA:\n"
+		"  --2dpca_n N        number of projection axes ([10])\n"
+		"\n"
+		"LBP:\n"
+		"  --lbp_grid N       number of cells along each side of the image ([8])\n"
 		"\n"
 		"kNN:\n"
 		"  --knn_k N          number of nearest neighbors to use\n"
-		"  --knn_dist [dist]  distance function to use (L1, [L2], COS)\n";
+		"  --knn_dist [dist]  distance function to use (L1, [L2], COS, CHI2); CHI2 requires non-negative\n"
+		"                     features (lbp, identity)\n"
+		"  --knn_chunk N      number of dimensions per early-abandon chunk ([16])\n"
+		"  --knn_layout [layout] gallery layout ([column], block8, block16)\n"
+		"  --knn_prefilter N  number of classes to shortlist by centroid distance ([0]=all)\n"
+		"  --knn_centroids N  number of k-means centroids per class for the prefilter ([1])\n"
+		"\n"
+		"Bayes:\n"
+		"  --bayes_batch N    number of samples to evaluate at once ([64], 0=unbatched)\n"
+		"  --bayes_reg X      covariance regularization relative to average variance ([0.01])\n"
+		"\n"
+		"Cascade:\n"
+		"  --cascade_coarse FEATURE  feature layer of the coarse model (identity, [pca], lda, ica, rp, 2dpca, lbp)\n"
+		"  --cascade_fine FEATURE    feature layer of the fine model (identity, pca, [lda], ica, rp, 2dpca, lbp)\n"
+		"  --cascade_margin X        escalate queries whose relative margin is below X ([0.1])\n"
+		"  --cascade_shortlist N     number of classes re-scored by the fine model ([10])\n";
 }
 
 
@@ -189,17 +452,31 @@ optarg_t parse_args(int argc, char **argv)
 	optarg_t args = {
 		false,
 		false,
-		false, 0,
+		false, 0, nullptr, nullptr, WritePolicy::Block, false, nullptr,
+		nullptr, false, nullptr,
+		0, 0, 0, 0, 0, 4,
+		nullptr, "scan.csv", 0, false,
+		false,
+		nullptr,
 		nullptr,
 		nullptr,
 		"./model.dat",
 		DataType::Image,
 		FeatureType::Identity,
 		ClassifierType::KNN,
+		0, 0,
+		EigenSolver::Full, 0, 0,
+		-1, 0.0f,
+		-1, -1, 0, 0.0f,
+		-1, -1, ICANonl::pow3, 1000, 0.0001f, 0, 0.0f,
+		100, 1,
+		10,
+		8,
+		1, MatchDist::L2, 16, 1, 0, 1,
+		64, 0.01f,
+		FeatureType::PCA, FeatureType::LDA, 0.1f, 10,
 		-1,
-		-1, -1,
-		-1, -1, ICANonl::pow3, 1000, 0.0001f,
-		1, KNNDist::L2
+		{}, {}
 	};
 
 	struct option long_options[] = {
@@ -208,19 +485,66 @@ optarg_t parse_args(int argc, char **argv)
 		{ "train", required_argument, 0, OPTION_TRAIN },
 		{ "test", required_argument, 0, OPTION_TEST },
 		{ "stream", no_argument, 0, OPTION_STREAM },
+		{ "stream_file", required_argument, 0, OPTION_STREAM_FILE },
+		{ "stream_output", required_argument, 0, OPTION_STREAM_OUTPUT },
+		{ "write_policy", required_argument, 0, OPTION_WRITE_POLICY },
+		{ "raw_results", no_argument, 0, OPTION_RAW_RESULTS },
+		{ "events", required_argument, 0, OPTION_EVENTS },
+		{ "record", required_argument, 0, OPTION_RECORD },
+		{ "record_crops", no_argument, 0, OPTION_RECORD_CROPS },
+		{ "replay", required_argument, 0, OPTION_REPLAY },
+		{ "motion", required_argument, 0, OPTION_MOTION },
+		{ "target_fps", required_argument, 0, OPTION_TARGET_FPS },
+		{ "quality_min", required_argument, 0, OPTION_QUALITY_MIN },
+		{ "quality_topk", required_argument, 0, OPTION_QUALITY_TOPK },
+		{ "hash_ttl", required_argument, 0, OPTION_HASH_TTL },
+		{ "hash_radius", required_argument, 0, OPTION_HASH_RADIUS },
+		{ "scan", required_argument, 0, OPTION_SCAN },
+		{ "scan_output", required_argument, 0, OPTION_SCAN_OUTPUT },
+		{ "scan_threads", required_argument, 0, OPTION_SCAN_THREADS },
+		{ "scan_overwrite", no_argument, 0, OPTION_SCAN_OVERWRITE },
+		{ "resume", no_argument, 0, OPTION_RESUME },
+		{ "cache", required_argument, 0, OPTION_CACHE },
 		{ "data", required_argument, 0, OPTION_DATA },
 		{ "feat", required_argument, 0, OPTION_FEATURE },
 		{ "clas", required_argument, 0, OPTION_CLASSIFIER },
+		{ "image_width", required_argument, 0, OPTION_IMAGE_WIDTH },
+		{ "image_height", required_argument, 0, OPTION_IMAGE_HEIGHT },
+		{ "solver", required_argument, 0, OPTION_SOLVER },
+		{ "threads", required_argument, 0, OPTION_THREADS },
+		{ "truncate", required_argument, 0, OPTION_TRUNCATE },
 		{ "pca_n1", required_argument, 0, OPTION_PCA_N1 },
+		{ "pca_energy", required_argument, 0, OPTION_PCA_ENERGY },
 		{ "lda_n1", required_argument, 0, OPTION_LDA_N1 },
 		{ "lda_n2", required_argument, 0, OPTION_LDA_N2 },
+		{ "lda_batch", required_argument, 0, OPTION_LDA_BATCH },
+		{ "lda_energy", required_argument, 0, OPTION_LDA_ENERGY },
 		{ "ica_n1", required_argument, 0, OPTION_ICA_N1 },
 		{ "ica_n2", required_argument, 0, OPTION_ICA_N2 },
 		{ "ica_nonl", required_argument, 0, OPTION_ICA_NONL },
 		{ "ica_max_iter", required_argument, 0, OPTION_ICA_MAX_ITER },
 		{ "ica_eps", required_argument, 0, OPTION_ICA_EPS },
+		{ "ica_checkpoint", required_argument, 0, OPTION_ICA_CHECKPOINT },
+		{ "ica_energy", required_argument, 0, OPTION_ICA_ENERGY },
+		{ "rp_n", required_argument, 0, OPTION_RP_N },
+		{ "rp_seed", required_argument, 0, OPTION_RP_SEED },
+		{ "2dpca_n", required_argument, 0, OPTION_PCA2D_N },
+		{ "lbp_grid", required_argument, 0, OPTION_LBP_GRID },
 		{ "knn_k", required_argument, 0, OPTION_KNN_K },
 		{ "knn_dist", required_argument, 0, OPTION_KNN_DIST },
+		{ "knn_chunk", required_argument, 0, OPTION_KNN_CHUNK },
+		{ "knn_layout", required_argument, 0, OPTION_KNN_LAYOUT },
+		{ "knn_prefilter", required_argument, 0, OPTION_KNN_PREFILTER },
+		{ "knn_centroids", required_argument, 0, OPTION_KNN_CENTROIDS },
+		{ "bayes_batch", required_argument, 0, OPTION_BAYES_BATCH },
+		{ "bayes_reg", required_argument, 0, OPTION_BAYES_REG },
+		{ "cascade_coarse", required_argument, 0, OPTION_CASCADE_COARSE },
+		{ "cascade_fine", required_argument, 0, OPTION_CASCADE_FINE },
+		{ "cascade_margin", required_argument, 0, OPTION_CASCADE_MARGIN },
+		{ "cascade_shortlist", required_argument, 0, OPTION_CASCADE_SHORTLIST },
+		{ "reject_threshold", required_argument, 0, OPTION_REJECT_THRESHOLD },
+		{ "grid_feat", required_argument, 0, OPTION_GRID_FEAT },
+		{ "grid_clas", required_argument, 0, OPTION_GRID_CLAS },
 		{ 0, 0, 0, 0 }
 	};
 
@@ -244,6 +568,72 @@ optarg_t parse_args(int argc, char **argv)
 		case OPTION_STREAM:
 			args.stream = true;
 			break;
+		case OPTION_STREAM_FILE:
+			args.stream = true;
+			args.path_stream = optarg;
+			break;
+		case OPTION_STREAM_OUTPUT:
+			args.path_stream_output = optarg;
+			break;
+		case OPTION_WRITE_POLICY:
+			try {
+				args.write_policy = write_policies.at(optarg);
+			}
+			catch ( std::exception& e ) {
+				args.write_policy = WritePolicy::None;
+			}
+			break;
+		case OPTION_RAW_RESULTS:
+			args.raw_results = true;
+			break;
+		case OPTION_EVENTS:
+			args.path_events = optarg;
+			break;
+		case OPTION_RECORD:
+			args.path_record = optarg;
+			break;
+		case OPTION_RECORD_CROPS:
+			args.record_crops = true;
+			break;
+		case OPTION_REPLAY:
+			args.path_replay = optarg;
+			break;
+		case OPTION_MOTION:
+			args.motion_interval = atoi(optarg);
+			break;
+		case OPTION_TARGET_FPS:
+			args.target_fps = atof(optarg);
+			break;
+		case OPTION_QUALITY_MIN:
+			args.quality_min = atof(optarg);
+			break;
+		case OPTION_QUALITY_TOPK:
+			args.quality_topk = atoi(optarg);
+			break;
+		case OPTION_HASH_TTL:
+			args.hash_ttl = atoi(optarg);
+			break;
+		case OPTION_HASH_RADIUS:
+			args.hash_radius = atoi(optarg);
+			break;
+		case OPTION_SCAN:
+			args.path_scan = optarg;
+			break;
+		case OPTION_SCAN_OUTPUT:
+			args.path_scan_output = optarg;
+			break;
+		case OPTION_SCAN_THREADS:
+			args.scan_threads = atoi(optarg);
+			break;
+		case OPTION_SCAN_OVERWRITE:
+			args.scan_overwrite = true;
+			break;
+		case OPTION_RESUME:
+			args.resume = true;
+			break;
+		case OPTION_CACHE:
+			args.path_cache = optarg;
+			break;
 		case OPTION_DATA:
 			try {
 				args.data_type = data_types.at(optarg);
@@ -268,15 +658,44 @@ optarg_t parse_args(int argc, char **argv)
 				args.classifier_type = ClassifierType::None;
 			}
 			break;
+		case OPTION_IMAGE_WIDTH:
+			args.image_width = atoi(optarg);
+			break;
+		case OPTION_IMAGE_HEIGHT:
+			args.image_height = atoi(optarg);
+			break;
+		case OPTION_SOLVER:
+			try {
+				args.solver = eigen_solvers.at(optarg);
+			}
+			catch ( std::exception& e ) {
+				args.solver = EigenSolver::None;
+			}
+			break;
+		case OPTION_THREADS:
+			args.threads = atoi(optarg);
+			break;
+		case OPTION_TRUNCATE:
+			args.truncate = atoi(optarg);
+			break;
 		case OPTION_PCA_N1:
 			args.pca_n1 = atoi(optarg);
 			break;
+		case OPTION_PCA_ENERGY:
+			args.pca_energy = atof(optarg);
+			break;
 		case OPTION_LDA_N1:
 			args.lda_n1 = atoi(optarg);
 			break;
 		case OPTION_LDA_N2:
 			args.lda_n2 = atoi(optarg);
 			break;
+		case OPTION_LDA_BATCH:
+			args.lda_batch = atoi(optarg);
+			break;
+		case OPTION_LDA_ENERGY:
+			args.lda_energy = atof(optarg);
+			break;
 		case OPTION_ICA_N1:
 			args.ica_n1 = atoi(optarg);
 			break;
@@ -297,6 +716,24 @@ optarg_t parse_args(int argc, char **argv)
 		case OPTION_ICA_EPS:
 			args.ica_eps = atof(optarg);
 			break;
+		case OPTION_ICA_CHECKPOINT:
+			args.ica_checkpoint = atoi(optarg);
+			break;
+		case OPTION_ICA_ENERGY:
+			args.ica_energy = atof(optarg);
+			break;
+		case OPTION_RP_N:
+			args.rp_n = atoi(optarg);
+			break;
+		case OPTION_RP_SEED:
+			args.rp_seed = atoi(optarg);
+			break;
+		case OPTION_PCA2D_N:
+			args.pca2d_n = atoi(optarg);
+			break;
+		case OPTION_LBP_GRID:
+			args.lbp_grid = atoi(optarg);
+			break;
 		case OPTION_KNN_K:
 			args.knn_k = atoi(optarg);
 			break;
@@ -305,7 +742,75 @@ optarg_t parse_args(int argc, char **argv)
 				args.knn_dist = dist_funcs.at(optarg);
 			}
 			catch ( std::exception& e ) {
-				args.knn_dist = KNNDist::none;
+				args.knn_dist = MatchDist::None;
+			}
+			break;
+		case OPTION_KNN_CHUNK:
+			args.knn_chunk = atoi(optarg);
+			break;
+		case OPTION_KNN_LAYOUT:
+			try {
+				args.knn_block = knn_layouts.at(optarg);
+			}
+			catch ( std::exception& e ) {
+				args.knn_block = -1;
+			}
+			break;
+		case OPTION_KNN_PREFILTER:
+			args.knn_prefilter = atoi(optarg);
+			break;
+		case OPTION_KNN_CENTROIDS:
+			args.knn_centroids = atoi(optarg);
+			break;
+		case OPTION_BAYES_BATCH:
+			args.bayes_batch = atoi(optarg);
+			break;
+		case OPTION_BAYES_REG:
+			args.bayes_reg = atof(optarg);
+			break;
+		case OPTION_CASCADE_COARSE:
+			try {
+				args.cascade_coarse = feature_types.at(optarg);
+			}
+			catch ( std::exception& e ) {
+				args.cascade_coarse = FeatureType::None;
+			}
+			break;
+		case OPTION_CASCADE_FINE:
+			try {
+				args.cascade_fine = feature_types.at(optarg);
+			}
+			catch ( std::exception& e ) {
+				args.cascade_fine = FeatureType::None;
+			}
+			break;
+		case OPTION_CASCADE_MARGIN:
+			args.cascade_margin = atof(optarg);
+			break;
+		case OPTION_CASCADE_SHORTLIST:
+			args.cascade_shortlist = atoi(optarg);
+			break;
+		case OPTION_REJECT_THRESHOLD:
+			args.reject_threshold = atof(optarg);
+			break;
+		case OPTION_GRID_FEAT:
+			for ( const std::string& name : split(optarg, ',') ) {
+				try {
+					args.grid_features.push_back(feature_types.at(name));
+				}
+				catch ( std::exception& e ) {
+					args.grid_features.push_back(FeatureType::None);
+				}
+			}
+			break;
+		case OPTION_GRID_CLAS:
+			for ( const std::string& name : split(optarg, ',') ) {
+				try {
+					args.grid_classifiers.push_back(classifier_types.at(name));
+				}
+				catch ( std::exception& e ) {
+					args.grid_classifiers.push_back(ClassifierType::None);
+				}
 			}
 			break;
 		case OPTION_UNKNOWN:
@@ -326,13 +831,61 @@ optarg_t parse_args(int argc, char **argv)
  */
 void validate_args(const optarg_t& args)
 {
+	// the chi-square distance is only valid for non-negative features
+	auto chi2_valid = [&args] (FeatureType type) {
+		return args.knn_dist != MatchDist::CHI2 || type == FeatureType::LBP || type == FeatureType::Identity;
+	};
+	bool grid_knn = std::count(args.grid_classifiers.begin(), args.grid_classifiers.end(), ClassifierType::KNN) > 0;
+
 	std::vector<std::pair<bool, std::string>> validators = {
-		{ args.train || args.test || args.stream, "--train / --test / --stream is required" },
-		{ args.data_type != DataType::None, "--data must be genome | image" },
-		{ args.feature_type != FeatureType::None, "--feat must be identity | pca | lda | ica" },
-		{ args.classifier_type != ClassifierType::None, "--clas must be knn | bayes" },
-		{ args.knn_dist != KNNDist::none, "--knn_dist must be L1 | L2 | COS" },
-		{ args.ica_nonl != ICANonl::none, "--ica_nonl must be pow3 | tanh | gauss" }
+		{ args.train || args.test || args.stream || args.path_scan != nullptr || args.path_replay != nullptr, "--train / --test / --stream / --scan / --replay is required" },
+		{ args.path_record == nullptr || (args.stream && args.path_replay == nullptr), "--record requires --stream" },
+		{ args.data_type != DataType::None, "--data must be genome | genome_bin | image" },
+		{ args.feature_type != FeatureType::None, "--feat must be identity | pca | lda | ica | rp | 2dpca | lbp" },
+		{ args.classifier_type != ClassifierType::None, "--clas must be knn | bayes | cascade" },
+		{ args.solver != EigenSolver::None, "--solver must be full | lanczos" },
+		{ args.threads >= 0, "--threads must be non-negative" },
+		{ args.truncate >= 0, "--truncate must be non-negative" },
+		{ args.truncate == 0 || args.train, "--truncate requires --train" },
+		{ 0 <= args.pca_energy && args.pca_energy <= 1, "--pca_energy must be between 0 and 1" },
+		{ 0 <= args.lda_energy && args.lda_energy <= 1, "--lda_energy must be between 0 and 1" },
+		{ 0 <= args.ica_energy && args.ica_energy <= 1, "--ica_energy must be between 0 and 1" },
+		{ args.classifier_type != ClassifierType::Cascade || args.feature_type == FeatureType::Identity, "--clas cascade requires --feat identity" },
+		{ args.cascade_coarse != FeatureType::None, "--cascade_coarse must be identity | pca | lda | ica | rp | 2dpca | lbp" },
+		{ args.cascade_fine != FeatureType::None, "--cascade_fine must be identity | pca | lda | ica | rp | 2dpca | lbp" },
+		{ args.cascade_margin >= 0, "--cascade_margin must be non-negative" },
+		{ args.cascade_shortlist > 0, "--cascade_shortlist must be positive" },
+		{ args.classifier_type != ClassifierType::Cascade || args.reject_threshold == 0, "--clas cascade does not support --reject_threshold" },
+		{ args.classifier_type != ClassifierType::Bayes || args.bayes_batch > 0 || args.reject_threshold == 0, "--reject_threshold with --clas bayes requires --bayes_batch" },
+		{ args.motion_interval >= 0, "--motion must be non-negative" },
+		{ args.target_fps >= 0, "--target_fps must be non-negative" },
+		{ args.quality_min >= 0 && args.quality_min <= 1, "--quality_min must be between 0 and 1" },
+		{ args.quality_topk >= 0, "--quality_topk must be non-negative" },
+		{ args.hash_ttl >= 0, "--hash_ttl must be non-negative" },
+		{ 0 <= args.hash_radius && args.hash_radius <= 64, "--hash_radius must be between 0 and 64" },
+		{ args.scan_threads >= 0, "--scan_threads must be non-negative" },
+		{ args.lda_batch >= 0, "--lda_batch must be non-negative" },
+		{ args.knn_dist != MatchDist::None, "--knn_dist must be L1 | L2 | COS | CHI2" },
+		{ args.classifier_type != ClassifierType::KNN || chi2_valid(args.feature_type), "--knn_dist CHI2 requires --feat lbp | identity" },
+		{ args.classifier_type != ClassifierType::Cascade || (chi2_valid(args.cascade_coarse) && chi2_valid(args.cascade_fine)), "--knn_dist CHI2 requires --cascade_coarse and --cascade_fine lbp | identity" },
+		{ !grid_knn || std::all_of(args.grid_features.begin(), args.grid_features.end(), chi2_valid), "--knn_dist CHI2 requires --grid_feat lbp | identity with --grid_clas knn" },
+		{ args.knn_chunk > 0, "--knn_chunk must be positive" },
+		{ args.knn_block > 0, "--knn_layout must be column | block8 | block16" },
+		{ args.knn_centroids > 0, "--knn_centroids must be positive" },
+		{ args.bayes_batch >= 0, "--bayes_batch must be non-negative" },
+		{ args.ica_nonl != ICANonl::none, "--ica_nonl must be pow3 | tanh | gauss" },
+		{ args.write_policy != WritePolicy::None, "--write_policy must be block | drop" },
+		{ args.ica_checkpoint >= 0, "--ica_checkpoint must be non-negative" },
+		{ args.rp_n > 0, "--rp_n must be positive" },
+		{ args.pca2d_n > 0, "--2dpca_n must be positive" },
+		{ args.lbp_grid > 0, "--lbp_grid must be positive" },
+		{ args.image_width >= 0 && args.image_height >= 0, "--image_width and --image_height must be non-negative" },
+		{ (args.image_width == 0) == (args.image_height == 0), "--image_width and --image_height must be used together" },
+		{ std::count(args.grid_features.begin(), args.grid_features.end(), FeatureType::None) == 0, "--grid_feat must be a list of identity | pca | lda | ica | rp | 2dpca | lbp" },
+		{ std::count(args.grid_classifiers.begin(), args.grid_classifiers.end(), ClassifierType::None) == 0, "--grid_clas must be a list of knn | bayes" },
+		{ std::count(args.grid_classifiers.begin(), args.grid_classifiers.end(), ClassifierType::Cascade) == 0, "--grid_clas does not support cascade" },
+		{ args.grid_features.empty() == args.grid_classifiers.empty(), "--grid_feat and --grid_clas must be used together" },
+		{ args.grid_features.empty() || (args.train && args.test), "--grid_feat requires --train and --test" }
 	};
 	bool valid = true;
 
@@ -352,207 +905,1419 @@ void validate_args(const optarg_t& args)
 
 
 /**
- * Detect faces in an image with a cascade classifier.
+ * Create a feature layer from the command-line arguments.
+ * Returns nullptr for the identity layer.
  *
- * @param image
- * @param cascade
+ * @param args
+ * @param type
  */
-std::vector<cv::Rect> detect_faces(cv::Mat& image, cv::CascadeClassifier& cascade)
+FeatureLayer * create_feature(const optarg_t& args, FeatureType type)
 {
-	cv::Mat image_gray;
-	cv::cvtColor(image, image_gray, CV_BGR2GRAY);
+	if ( type == FeatureType::PCA ) {
+		return create_pca(args.solver, args.pca_n1, args.pca_energy);
+	}
+	else if ( type == FeatureType::LDA && args.lda_batch == 0 && args.solver == EigenSolver::Full && args.lda_energy == 0 ) {
+		return new LDALayer(args.lda_n1, args.lda_n2);
+	}
+	else if ( type == FeatureType::LDA ) {
+		return new StreamLDALayer(args.lda_n1, args.lda_n2, args.lda_batch, args.solver, args.lda_energy);
+	}
+	else if ( type == FeatureType::ICA && args.ica_checkpoint == 0 && !args.resume && args.solver == EigenSolver::Full && args.ica_energy == 0 ) {
+		return new ICALayer(
+			args.ica_n1,
+			args.ica_n2,
+			args.ica_nonl,
+			args.ica_max_iter,
+			args.ica_eps
+		);
+	}
+	else if ( type == FeatureType::ICA ) {
+		return new CheckpointICALayer(
+			args.ica_n1,
+			args.ica_n2,
+			args.ica_nonl,
+			args.ica_max_iter,
+			args.ica_eps,
+			args.ica_checkpoint,
+			std::string(args.path_model) + ".ckpt",
+			args.resume,
+			args.solver,
+			args.ica_energy
+		);
+	}
+	else if ( type == FeatureType::RP ) {
+		return new RandomProjectionLayer(args.rp_n, args.rp_seed);
+	}
+	else if ( type == FeatureType::PCA2D ) {
+		return new PCA2DLayer(args.pca2d_n, args.image_width, args.image_height);
+	}
+	else if ( type == FeatureType::LBP ) {
+		return new LBPLayer(args.lbp_grid, args.image_width, args.image_height);
+	}
 
-	std::vector<cv::Rect> rects;
-	cascade.detectMultiScale(image_gray, rects, 1.3, 5);
+	return nullptr;
+}
 
-	return rects;
+
+
+/**
+ * Create a classifier layer from the command-line arguments.
+ * The cascade classifier requires the cascade feature layer
+ * of the model.
+ *
+ * @param args
+ * @param type
+ * @param feature
+ */
+ClassifierLayer * create_classifier(const optarg_t& args, ClassifierType type, FeatureLayer *feature=nullptr)
+{
+	if ( type == ClassifierType::KNN ) {
+		return new GalleryLayer(
+			args.knn_k,
+			args.knn_dist,
+			args.reject_threshold,
+			args.knn_chunk,
+			args.knn_block,
+			args.knn_prefilter,
+			args.knn_centroids
+		);
+	}
+	else if ( type == ClassifierType::Bayes && args.bayes_batch == 0 ) {
+		return new BayesLayer();
+	}
+	else if ( type == ClassifierType::Bayes ) {
+		return new BatchBayesLayer(args.bayes_batch, args.bayes_reg, args.reject_threshold);
+	}
+	else if ( type == ClassifierType::Cascade ) {
+		return new CascadeLayer(
+			dynamic_cast<CascadeFeatureLayer *>(feature),
+			args.knn_dist,
+			args.cascade_margin,
+			args.cascade_shortlist,
+			args.knn_chunk,
+			args.knn_block
+		);
+	}
+
+	return nullptr;
 }
 
 
 
 /**
- * Classify faces in an image with a classification model.
+ * Get the cache key of a feature layer, which identifies
+ * the layer and every hyperparameter that affects its fit.
  *
- * @param image
- * @param rects
- * @param model
+ * @param args
+ * @param type
  */
-std::vector<std::string> classify_faces(cv::Mat& image, const std::vector<cv::Rect>& rects, ClassificationModel& model)
+std::string feature_key(const optarg_t& args, FeatureType type)
 {
-	const cv::Size IMAGE_SIZE(128, 128);
+	char key[256];
 
-	BBoxIterator data_iter(image, rects, IMAGE_SIZE);
-	Dataset dataset(&data_iter);
+	if ( type == FeatureType::PCA ) {
+		snprintf(key, sizeof(key), "pca n1=%d energy=%g solver=%d", args.pca_n1, args.pca_energy, (int) args.solver);
+	}
+	else if ( type == FeatureType::LDA ) {
+		snprintf(key, sizeof(key), "lda n1=%d n2=%d batch=%d energy=%g solver=%d", args.lda_n1, args.lda_n2, args.lda_batch, args.lda_energy, (int) args.solver);
+	}
+	else if ( type == FeatureType::ICA ) {
+		snprintf(key, sizeof(key), "ica n1=%d n2=%d nonl=%d max_iter=%d eps=%g checkpoint=%d energy=%g solver=%d",
+			args.ica_n1,
+			args.ica_n2,
+			(int) args.ica_nonl,
+			args.ica_max_iter,
+			args.ica_eps,
+			args.ica_checkpoint > 0 || args.resume,
+			args.ica_energy,
+			(int) args.solver);
+	}
+	else if ( type == FeatureType::RP ) {
+		snprintf(key, sizeof(key), "rp n=%d seed=%d", args.rp_n, args.rp_seed);
+	}
+	else if ( type == FeatureType::PCA2D ) {
+		snprintf(key, sizeof(key), "2dpca n=%d width=%d height=%d", args.pca2d_n, args.image_width, args.image_height);
+	}
+	else if ( type == FeatureType::LBP ) {
+		snprintf(key, sizeof(key), "lbp grid=%d width=%d height=%d", args.lbp_grid, args.image_width, args.image_height);
+	}
+	else {
+		key[0] = '\0';
+	}
 
-	std::vector<int> y_pred = model.predict(dataset);
+	return key;
+}
 
-	std::vector<std::string> labels;
 
-	for ( auto y_i : y_pred ) {
-		auto& label = model.train_set().classes()[y_i];
-		labels.push_back(label);
+
+/**
+ * Print the results of open-set recognition on a test set.
+ * Rejected samples are counted separately so that they are
+ * not mistaken for misclassified samples, and the accuracy
+ * is measured only on the accepted samples.
+ *
+ * @param test_set
+ * @param classes
+ * @param y_pred
+ */
+void print_rejected(const Dataset& test_set, const std::vector<std::string>& classes, const std::vector<int>& y_pred)
+{
+	int num_rejected = 0;
+	int num_correct = 0;
+
+	for ( size_t i = 0; i < y_pred.size(); i++ ) {
+		if ( y_pred[i] < 0 ) {
+			log(LogLevel::Verbose, "%-20s rejected", test_set.entries()[i].name.c_str());
+			num_rejected++;
+		}
+		else if ( classes[y_pred[i]] == test_set.entries()[i].label ) {
+			num_correct++;
+		}
 	}
 
-	return labels;
+	int num_accepted = y_pred.size() - num_rejected;
+
+	log(LogLevel::Info, "rejected %d / %d samples as unknown", num_rejected, (int) y_pred.size());
+	log(LogLevel::Info, "accept rate: %.3f", (float) num_accepted / y_pred.size());
+	log(LogLevel::Info, "accuracy on accepted samples: %.3f", (num_accepted > 0) ? (float) num_correct / num_accepted : 0.0f);
 }
 
 
 
 /**
- * Annotate each face in an image with a bounding box and label.
+ * Detect faces in an image with a cascade classifier. The image
+ * can be downscaled before detection to reduce the cost, in which
+ * case the faces are scaled back to the original image.
  *
  * @param image
- * @param rects
- * @param labels
+ * @param cascade
+ * @param scale_factor
+ * @param downscale
  */
-void label_faces(cv::Mat& image, const std::vector<cv::Rect>& rects, const std::vector<std::string>& labels)
+std::vector<cv::Rect> detect_faces(cv::Mat& image, cv::CascadeClassifier& cascade, double scale_factor=1.3, int downscale=1)
 {
-	const cv::Scalar RECT_COLOR(255, 0, 0);
-	const int RECT_THICKNESS = 2;
-	const int TEXT_FONT = cv::FONT_HERSHEY_COMPLEX_SMALL;
-	const double TEXT_SCALE = 1;
-	const cv::Scalar TEXT_COLOR(255, 255, 255);
+	cv::Mat image_gray;
+	cv::cvtColor(image, image_gray, CV_BGR2GRAY);
 
-	for ( size_t i = 0; i < rects.size(); i++ ) {
-		cv::rectangle(image, rects[i], RECT_COLOR, RECT_THICKNESS);
-		cv::putText(image, labels[i], rects[i].tl(), TEXT_FONT, TEXT_SCALE, TEXT_COLOR);
+	if ( downscale > 1 ) {
+		cv::resize(image_gray, image_gray, cv::Size(image.cols / downscale, image.rows / downscale), 0, 0, cv::INTER_AREA);
+	}
+
+	std::vector<cv::Rect> rects;
+	cascade.detectMultiScale(image_gray, rects, scale_factor, 5);
+
+	for ( auto& rect : rects ) {
+		rect = cv::Rect(rect.x * downscale, rect.y * downscale, rect.width * downscale, rect.height * downscale);
 	}
+
+	return rects;
 }
 
 
 
 /**
- * Perform face recognition in real time on a video stream.
+ * Get the label name of a match, or "unknown" if the
+ * match was rejected.
  *
- * @param device
  * @param model
+ * @param match
  */
-void stream(int device, ClassificationModel& model)
+std::string match_label(ClassificationModel& model, const Match& match)
 {
-	cv::VideoCapture cap(device);
-	cv::CascadeClassifier cascade("scripts/face-det/haarcascade_frontalface_alt.xml");
+	return (match.y >= 0)
+		? model.train_set().classes()[match.y]
+		: "unknown";
+}
 
-	if ( !cap.isOpened() ) {
-		std::cerr << "error: could not open video stream\n";
+
+
+const cv::Size FACE_SIZE(128, 128);
+
+
+
+/**
+ * Check that the face crops have the image shape of
+ * an image feature layer.
+ *
+ * @param name
+ * @param width
+ * @param height
+ */
+void check_face_shape(const char *name, int width, int height)
+{
+	if ( width != FACE_SIZE.width || height != FACE_SIZE.height ) {
+		std::cerr << "error: " << name << " model has image shape "
+			<< width << "x" << height
+			<< ", but face crops are "
+			<< FACE_SIZE.width << "x" << FACE_SIZE.height << "\n";
 		exit(1);
 	}
+}
 
-	while ( true ) {
-		cv::Mat frame;
 
-		if ( !cap.read(frame) ) {
-			std::cerr << "error: could not read video frame\n";
-			continue;
-		}
 
-		std::vector<cv::Rect> rects = detect_faces(frame, cascade);
+/**
+ * Classify the face crops of a bounding-box iterator with
+ * a classification model.
+ *
+ * If the classifier reports matches, each result includes
+ * the distance and margin of the match; otherwise only the
+ * label is provided.
+ *
+ * @param data_iter
+ * @param model
+ * @param matcher
+ */
+std::vector<Match> predict_faces(BBoxIterator& data_iter, ClassificationModel& model, MatchLayer *matcher)
+{
+	Dataset dataset(&data_iter);
 
-		if ( rects.size() > 0 ) {
-			std::vector<std::string> labels = classify_faces(frame, rects, model);
+	std::vector<int> y_pred = model.predict(dataset);
 
-			label_faces(frame, rects, labels);
-		}
+	if ( matcher != nullptr ) {
+		return matcher->matches();
+	}
 
-		cv::imshow("Face Detection", frame);
+	std::vector<Match> matches;
 
-		if ( cv::waitKey(30) == 27 ) {
-			break;
-		}
+	for ( auto y_i : y_pred ) {
+		matches.push_back(Match { y_i, 0, 0 });
 	}
+
+	return matches;
 }
 
 
 
-int main(int argc, char **argv)
+/**
+ * Classify the face crops of a bounding-box iterator, reusing the
+ * cached result of a similar crop where possible. Only the crops
+ * without a cached result are classified, and their results are
+ * added to the cache.
+ *
+ * @param data_iter
+ * @param model
+ * @param matcher
+ * @param cache
+ * @param frame
+ */
+std::vector<Match> predict_faces_cached(BBoxIterator& data_iter, ClassificationModel& model, MatchLayer *matcher, MatchCache& cache, int frame)
 {
-	// parse command-line arguments
-	optarg_t args = parse_args(argc, argv);
+	std::vector<uint64_t> hashes = data_iter.hashes();
+	std::vector<Match> matches(hashes.size());
+	std::vector<int> indices;
 
-	// validate arguments
-	validate_args(args);
+	for ( size_t i = 0; i < hashes.size(); i++ ) {
+		if ( !cache.lookup(hashes[i], frame, matches[i]) ) {
+			indices.push_back(i);
+		}
+	}
 
-	// initialize random number engine
-	Random::seed();
+	if ( !indices.empty() ) {
+		data_iter.select(indices);
 
-	// initialize feature layer
-	std::unique_ptr<FeatureLayer> feature;
+		std::vector<Match> results = predict_faces(data_iter, model, matcher);
 
-	if ( args.feature_type == FeatureType::Identity ) {
-		feature.reset();
-	}
-	else if ( args.feature_type == FeatureType::PCA ) {
-		feature.reset(new PCALayer(args.pca_n1));
-	}
-	else if ( args.feature_type == FeatureType::LDA ) {
-		feature.reset(new LDALayer(args.lda_n1, args.lda_n2));
+		for ( size_t j = 0; j < indices.size(); j++ ) {
+			matches[indices[j]] = results[j];
+			cache.insert(hashes[indices[j]], frame, results[j]);
+		}
 	}
-	else if ( args.feature_type == FeatureType::ICA ) {
-		feature.reset(new ICALayer(
-			args.ica_n1,
-			args.ica_n2,
-			args.ica_nonl,
-			args.ica_max_iter,
-			args.ica_eps
+
+	return matches;
+}
+
+
+
+/**
+ * Classify faces in an image with a classification model.
+ *
+ * @param image
+ * @param rects
+ * @param model
+ * @param matcher
+ */
+std::vector<Match> classify_faces(cv::Mat& image, const std::vector<cv::Rect>& rects, ClassificationModel& model, MatchLayer *matcher)
+{
+	BBoxIterator data_iter(image, rects, FACE_SIZE);
+
+	return predict_faces(data_iter, model, matcher);
+}
+
+
+
+/**
+ * Label tracked faces in an image. Each face is associated with
+ * a track, and only the crops selected by the tracker are
+ * classified; the other faces keep the label of their track.
+ * Until the classification refresh is due, only the faces of new
+ * tracks are considered. Selected crops are classified through
+ * the match cache if one is given. An event is emitted for each
+ * classified face.
+ *
+ * @param image
+ * @param rects
+ * @param model
+ * @param matcher
+ * @param tracker
+ * @param cache
+ * @param frame
+ * @param refresh
+ * @param events
+ * @param timestamp
+ */
+std::vector<std::string> classify_tracked_faces(cv::Mat& image, const std::vector<cv::Rect>& rects, ClassificationModel& model, MatchLayer *matcher, FaceTracker& tracker, MatchCache *cache, int frame, bool refresh, EventSink *events, double timestamp)
+{
+	BBoxIterator data_iter(image, rects, FACE_SIZE);
+	std::vector<int> tracks = tracker.update(rects);
+	std::vector<int> indices;
+
+	for ( size_t i = 0; i < rects.size(); i++ ) {
+		if ( (refresh || tracker.label(tracks[i]).empty()) && tracker.want(tracks[i], data_iter.quality()[i]) ) {
+			indices.push_back(i);
+		}
+	}
+
+	if ( !indices.empty() ) {
+		std::vector<float> quality = data_iter.quality();
+
+		data_iter.select(indices);
+
+		std::vector<Match> matches = cache
+			? predict_faces_cached(data_iter, model, matcher, *cache, frame)
+			: predict_faces(data_iter, model, matcher);
+
+		for ( size_t j = 0; j < indices.size(); j++ ) {
+			int i = indices[j];
+
+			tracker.set_label(tracks[i], quality[i], match_label(model, matches[j]));
+
+			if ( events != nullptr ) {
+				events->push(event_t { timestamp, tracker.id(tracks[i]), rects[i], tracker.label(tracks[i]), matches[j].dist });
+			}
+		}
+	}
+
+	std::vector<std::string> labels;
+
+	for ( int t : tracks ) {
+		labels.push_back(tracker.label(t));
+	}
+
+	return labels;
+}
+
+
+
+/**
+ * Annotate each face in an image with a bounding box and label.
+ *
+ * @param image
+ * @param rects
+ * @param labels
+ */
+void label_faces(cv::Mat& image, const std::vector<cv::Rect>& rects, const std::vector<std::string>& labels)
+{
+	const cv::Scalar RECT_COLOR(255, 0, 0);
+	const int RECT_THICKNESS = 2;
+	const int TEXT_FONT = cv::FONT_HERSHEY_COMPLEX_SMALL;
+	const double TEXT_SCALE = 1;
+	const cv::Scalar TEXT_COLOR(255, 255, 255);
+
+	for ( size_t i = 0; i < rects.size(); i++ ) {
+		cv::rectangle(image, rects[i], RECT_COLOR, RECT_THICKNESS);
+		cv::putText(image, labels[i], rects[i].tl(), TEXT_FONT, TEXT_SCALE, TEXT_COLOR);
+	}
+}
+
+
+
+/**
+ * Perform face recognition in real time on a video stream.
+ *
+ * @param device
+ * @param model
+ * @param matcher
+ */
+void stream(const optarg_t& args, ClassificationModel& model, MatchLayer *matcher)
+{
+	cv::VideoCapture cap;
+	cv::CascadeClassifier cascade("scripts/face-det/haarcascade_frontalface_alt.xml");
+
+	if ( args.path_stream != nullptr ) {
+		cap.open(args.path_stream);
+	}
+	else {
+		cap.open(args.stream_dev);
+	}
+
+	if ( !cap.isOpened() ) {
+		std::cerr << "error: could not open video stream\n";
+		exit(1);
+	}
+
+	std::unique_ptr<MotionDetector> motion;
+	std::unique_ptr<QoSController> qos;
+
+	if ( args.motion_interval > 0 ) {
+		motion.reset(new MotionDetector(4, args.motion_interval));
+	}
+
+	if ( args.target_fps > 0 ) {
+		qos.reset(new QoSController(args.target_fps));
+	}
+
+	std::unique_ptr<FaceTracker> tracker;
+
+	if ( args.quality_min > 0 || args.quality_topk > 0 ) {
+		tracker.reset(new FaceTracker(args.quality_min, args.quality_topk));
+	}
+
+	std::unique_ptr<MatchCache> hash_cache;
+
+	if ( args.hash_ttl > 0 ) {
+		hash_cache.reset(new MatchCache(args.hash_radius, args.hash_ttl));
+	}
+
+	// write the output to a file on a separate thread if specified,
+	// in which case there is no window
+	std::unique_ptr<AsyncVideoWriter> writer;
+	std::unique_ptr<EventSink> events;
+	std::unique_ptr<DetectionWriter> recorder;
+	bool display = (args.path_stream_output == nullptr && !args.raw_results);
+
+	if ( args.path_stream_output != nullptr ) {
+		double fps = cap.get(CV_CAP_PROP_FPS);
+		annotate_func_t annotate = args.raw_results ? nullptr : label_faces;
+
+		writer.reset(new AsyncVideoWriter(args.path_stream_output, (fps > 0) ? fps : 30, annotate, args.write_policy));
+	}
+
+	if ( args.path_events != nullptr ) {
+		std::string camera = (args.path_stream != nullptr)
+			? args.path_stream
+			: std::to_string(args.stream_dev);
+
+		events.reset(new EventSink(args.path_events, camera));
+	}
+
+	if ( args.path_record != nullptr ) {
+		recorder.reset(new DetectionWriter(args.path_record, args.record_crops, FACE_SIZE));
+	}
+
+	operating_point_t point = { 1.3, 1, 1, 1 };
+	std::vector<cv::Rect> rects;
+	std::vector<std::string> labels;
+	int num_frames = 0;
+	int frames_since_classify = 0;
+	std::clock_t cpu_time = 0;
+	float output_time = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	while ( true ) {
+		cv::Mat frame;
+
+		if ( !cap.read(frame) ) {
+			if ( args.path_stream != nullptr ) {
+				break;
+			}
+
+			std::cerr << "error: could not read video frame\n";
+			continue;
+		}
+
+		std::clock_t frame_start = std::clock();
+		auto frame_wall = std::chrono::steady_clock::now();
+		double timestamp = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		if ( qos ) {
+			point = qos->point();
+		}
+
+		// detect faces in the whole frame or in the regions
+		// with motion, or keep the previous faces if nothing moved
+		// or if detection is skipped on this frame
+		std::vector<cv::Rect> prev_rects = rects;
+		std::vector<cv::Rect> regions;
+
+		if ( num_frames % point.detect_interval != 0 ) {
+			// keep previous faces
+		}
+		else if ( !motion || motion->update(frame, regions) ) {
+			rects = detect_faces(frame, cascade, point.scale_factor, point.downscale);
+		}
+		else if ( !regions.empty() ) {
+			rects.clear();
+
+			for ( auto& region : regions ) {
+				cv::Mat roi = frame(region);
+
+				for ( auto& rect : detect_faces(roi, cascade, point.scale_factor, point.downscale) ) {
+					rects.push_back(cv::Rect(rect.x + region.x, rect.y + region.y, rect.width, rect.height));
+				}
+			}
+		}
+
+		if ( recorder ) {
+			recorder->write(num_frames, frame, rects);
+		}
+
+		// classify faces if the faces have changed, reusing the
+		// previous labels until the classification refresh is due
+		frames_since_classify++;
+
+		bool refresh = (frames_since_classify >= point.classify_interval);
+
+		// with a tracker, faces are labeled by their tracks and only
+		// the best crops of each track are classified
+		if ( tracker ) {
+			if ( rects.size() != labels.size() || rects != prev_rects ) {
+				labels = classify_tracked_faces(frame, rects, model, matcher, *tracker, hash_cache.get(), num_frames, refresh, events.get(), timestamp);
+
+				if ( refresh ) {
+					frames_since_classify = 0;
+				}
+			}
+		}
+		else if ( rects.size() != labels.size() || (rects != prev_rects && refresh) ) {
+			std::vector<Match> matches;
+
+			if ( !rects.empty() && hash_cache ) {
+				BBoxIterator data_iter(frame, rects, FACE_SIZE);
+
+				matches = predict_faces_cached(data_iter, model, matcher, *hash_cache, num_frames);
+			}
+			else if ( !rects.empty() ) {
+				matches = classify_faces(frame, rects, model, matcher);
+			}
+
+			labels.clear();
+
+			for ( auto& match : matches ) {
+				labels.push_back(match_label(model, match));
+			}
+
+			if ( events ) {
+				for ( size_t i = 0; i < matches.size(); i++ ) {
+					events->push(event_t { timestamp, -1, rects[i], labels[i], matches[i].dist });
+				}
+			}
+
+			frames_since_classify = 0;
+		}
+
+		cpu_time += std::clock() - frame_start;
+		num_frames++;
+
+		// print the results, hand the frame to the video writer,
+		// or draw the results and display the frame
+		auto output_start = std::chrono::steady_clock::now();
+
+		if ( args.raw_results ) {
+			for ( size_t i = 0; i < rects.size(); i++ ) {
+				std::cout
+					<< num_frames << ","
+					<< rects[i].x << "," << rects[i].y << ","
+					<< rects[i].width << "," << rects[i].height << ","
+					<< labels[i] << "\n";
+			}
+		}
+
+		if ( writer ) {
+			writer->write(frame, rects, labels);
+		}
+		else if ( display ) {
+			label_faces(frame, rects, labels);
+			cv::imshow("Face Detection", frame);
+		}
+
+		auto output_end = std::chrono::steady_clock::now();
+
+		output_time += std::chrono::duration<float>(output_end - output_start).count();
+
+		if ( qos ) {
+			qos->update(std::chrono::duration<float>(output_end - frame_wall).count());
+		}
+
+		if ( display && cv::waitKey(30) == 27 ) {
+			break;
+		}
+	}
+
+	if ( writer ) {
+		writer->close();
+	}
+
+	if ( events ) {
+		events->close();
+	}
+
+	// print CPU usage of the processing, excluding output, and the
+	// time spent on the output on the processing thread
+	float wall_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	float cpu_secs = (float) cpu_time / CLOCKS_PER_SEC;
+
+	if ( num_frames > 0 ) {
+		log(LogLevel::Info, "stream: %d frames, %.3f ms CPU per frame, %.1f%% of one core",
+			num_frames,
+			1000 * cpu_secs / num_frames,
+			100 * cpu_secs / wall_time);
+		log(LogLevel::Info, "stream: output %.3f ms per frame on the processing thread",
+			1000 * output_time / num_frames);
+	}
+
+	if ( motion ) {
+		motion->print_stats();
+	}
+
+	if ( qos ) {
+		qos->print_stats();
+	}
+
+	if ( tracker ) {
+		tracker->print_stats();
+	}
+
+	if ( hash_cache ) {
+		hash_cache->print_stats();
+	}
+
+	if ( writer ) {
+		writer->print_stats();
+	}
+
+	if ( events ) {
+		events->print_stats();
+	}
+
+	if ( recorder ) {
+		recorder->print_stats();
+	}
+}
+
+
+
+/**
+ * Classify the faces of a detection log as fast as possible.
+ * If the log contains face crops they are classified directly;
+ * otherwise the frames are decoded from the video stream, but
+ * the cascade is not run. Only the classification is timed.
+ *
+ * @param args
+ * @param model
+ * @param matcher
+ */
+void replay(const optarg_t& args, ClassificationModel& model, MatchLayer *matcher)
+{
+	DetectionReader reader(args.path_replay);
+	cv::VideoCapture cap;
+
+	if ( !reader.crops() ) {
+		if ( args.path_stream == nullptr || !cap.open(args.path_stream) ) {
+			std::cerr << "error: --replay requires --stream_file when the recording has no crops\n";
+			exit(1);
+		}
+	}
+
+	std::unique_ptr<MatchCache> hash_cache;
+
+	if ( args.hash_ttl > 0 ) {
+		hash_cache.reset(new MatchCache(args.hash_radius, args.hash_ttl));
+	}
+
+	detection_record_t record;
+	cv::Mat frame;
+	int video_frame = 0;
+	int num_frames = 0;
+	long num_faces = 0;
+	float classify_time = 0;
+
+	while ( reader.read(record) ) {
+		// decode frames up to the recorded frame
+		while ( !reader.crops() && video_frame <= record.frame ) {
+			if ( !cap.read(frame) ) {
+				std::cerr << "error: video stream ended before frame " << record.frame << "\n";
+				exit(1);
+			}
+
+			video_frame++;
+		}
+
+		num_frames++;
+
+		if ( record.rects.empty() ) {
+			continue;
+		}
+
+		// classify faces
+		auto start = std::chrono::steady_clock::now();
+
+		std::unique_ptr<BBoxIterator> data_iter(reader.crops()
+			? new BBoxIterator(record.faces)
+			: new BBoxIterator(frame, record.rects, FACE_SIZE));
+
+		std::vector<Match> matches = hash_cache
+			? predict_faces_cached(*data_iter, model, matcher, *hash_cache, record.frame)
+			: predict_faces(*data_iter, model, matcher);
+
+		classify_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		num_faces += matches.size();
+
+		if ( args.raw_results ) {
+			for ( size_t i = 0; i < matches.size(); i++ ) {
+				const cv::Rect& rect = record.rects[i];
+
+				std::cout
+					<< record.frame + 1 << ","
+					<< rect.x << "," << rect.y << ","
+					<< rect.width << "," << rect.height << ","
+					<< match_label(model, matches[i]) << "\n";
+			}
+		}
+	}
+
+	log(LogLevel::Info, "replay: %d frames, %ld faces, %.3f s classifying, %.3f ms per face, %.1f faces/s",
+		num_frames,
+		num_faces,
+		classify_time,
+		(num_faces > 0) ? 1000 * classify_time / num_faces : 0.0f,
+		(classify_time > 0) ? num_faces / classify_time : 0.0f);
+
+	if ( hash_cache ) {
+		hash_cache->print_stats();
+	}
+}
+
+
+
+/**
+ * List the image files in a directory tree.
+ *
+ * @param path
+ * @param files
+ */
+void list_images(const std::string& path, std::vector<std::string>& files)
+{
+	const std::vector<std::string> EXTENSIONS = { ".bmp", ".jpeg", ".jpg", ".pgm", ".png", ".ppm", ".tif", ".tiff" };
+
+	DIR *dir = opendir(path.c_str());
+
+	if ( dir == nullptr ) {
+		std::cerr << "warning: could not open directory " << path << "\n";
+		return;
+	}
+
+	struct dirent *entry;
+
+	while ( (entry = readdir(dir)) != nullptr ) {
+		std::string name = entry->d_name;
+
+		if ( name == "." || name == ".." ) {
+			continue;
+		}
+
+		std::string filename = path + "/" + name;
+
+		if ( entry->d_type == DT_DIR ) {
+			list_images(filename, files);
+			continue;
+		}
+
+		size_t dot = name.rfind('.');
+		std::string ext = (dot != std::string::npos) ? name.substr(dot) : "";
+
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+		if ( std::find(EXTENSIONS.begin(), EXTENSIONS.end(), ext) != EXTENSIONS.end() ) {
+			files.push_back(filename);
+		}
+	}
+
+	closedir(dir);
+}
+
+
+
+typedef struct {
+	std::string filename;
+	cv::Mat image;
+	std::vector<cv::Rect> rects;
+} scan_item_t;
+
+
+
+/**
+ * Perform face recognition on every image in a directory tree.
+ *
+ * The scan is a pipeline of two stages. Several worker threads
+ * decode images and detect faces, each with its own cascade, and
+ * the main thread classifies the detected faces, since the model
+ * is not thread-safe. The stages are connected by a bounded queue,
+ * so the workers cannot run ahead of the classifier by more than
+ * a few images. The results are appended to a CSV file, and files
+ * which were completed by a previous run are skipped.
+ *
+ * @param args
+ * @param model
+ * @param matcher
+ */
+void scan(const optarg_t& args, ClassificationModel& model, MatchLayer *matcher)
+{
+	const std::string CASCADE_PATH = "scripts/face-det/haarcascade_frontalface_alt.xml";
+
+	auto start = std::chrono::steady_clock::now();
+
+	// list files which have not been scanned yet, resuming only
+	// a scan of the same model
+	char key[64];
+	snprintf(key, sizeof(key), "%016" PRIx64, hash_file(args.path_model));
+
+	ScanJournal journal(args.path_scan_output, std::string(args.path_model) + " " + key, args.scan_overwrite);
+	std::vector<std::string> files;
+
+	list_images(args.path_scan, files);
+	std::sort(files.begin(), files.end());
+
+	int num_listed = files.size();
+
+	files.erase(std::remove_if(files.begin(), files.end(), [&] (const std::string& filename) {
+		return journal.completed(filename);
+	}), files.end());
+
+	log(LogLevel::Info, "scan: %d images in %s, %d to scan", num_listed, args.path_scan, (int) files.size());
+
+	// start decode and detection workers
+	int num_threads = (args.scan_threads > 0)
+		? args.scan_threads
+		: std::max(1u, std::thread::hardware_concurrency());
+
+	WorkQueue<scan_item_t> queue(2 * num_threads);
+	std::atomic<size_t> next_file(0);
+	std::atomic<int> num_failed(0);
+	std::vector<float> detect_time(num_threads, 0);
+	std::vector<std::thread> workers;
+
+	for ( int t = 0; t < num_threads; t++ ) {
+		workers.emplace_back([&, t] () {
+			cv::CascadeClassifier cascade(CASCADE_PATH);
+
+			for ( size_t i = next_file++; i < files.size(); i = next_file++ ) {
+				auto start = std::chrono::steady_clock::now();
+
+				scan_item_t item;
+				item.filename = files[i];
+				item.image = cv::imread(files[i]);
+
+				if ( item.image.empty() ) {
+					std::cerr << "warning: could not decode " << files[i] << "\n";
+					num_failed++;
+				}
+				else {
+					item.rects = detect_faces(item.image, cascade);
+				}
+
+				detect_time[t] += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+				queue.push(std::move(item));
+			}
+		});
+	}
+
+	std::thread closer([&] () {
+		for ( std::thread& worker : workers ) {
+			worker.join();
+		}
+
+		queue.close();
+	});
+
+	// classify faces and write results as they arrive
+	scan_item_t item;
+	int num_files = 0;
+	int num_faces = 0;
+	float classify_time = 0;
+
+	while ( queue.pop(item) ) {
+		auto classify_start = std::chrono::steady_clock::now();
+
+		std::vector<Match> matches = item.rects.empty()
+			? std::vector<Match>()
+			: classify_faces(item.image, item.rects, model, matcher);
+
+		classify_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - classify_start).count();
+
+		// quote the file name, since it may contain commas
+		std::string quoted = item.filename;
+		size_t pos = 0;
+
+		while ( (pos = quoted.find('"', pos)) != std::string::npos ) {
+			quoted.insert(pos, "\"");
+			pos += 2;
+		}
+
+		std::ostringstream rows;
+
+		for ( size_t i = 0; i < matches.size(); i++ ) {
+			const cv::Rect& rect = item.rects[i];
+
+			rows << "\"" << quoted << "\","
+				<< rect.x << "," << rect.y << "," << rect.width << "," << rect.height << ","
+				<< match_label(model, matches[i]) << ","
+				<< matches[i].dist << "\n";
+		}
+
+		journal.write(item.filename, rows.str(), matches.size());
+
+		num_files++;
+		num_faces += matches.size();
+	}
+
+	closer.join();
+
+	// print throughput and the busy time of each stage
+	float wall_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	float total_detect_time = 0;
+
+	for ( float time : detect_time ) {
+		total_detect_time += time;
+	}
+
+	log(LogLevel::Info, "scan: %d files, %d faces, %d failed, %.3f s (%.1f files/s)",
+		num_files,
+		num_faces,
+		(int) num_failed,
+		wall_time,
+		num_files / wall_time);
+	log(LogLevel::Info, "scan: decode+detect %.3f s on %d threads (%.1f%% busy), classify %.3f s (%.1f%% busy)",
+		total_detect_time,
+		num_threads,
+		100 * total_detect_time / (num_threads * wall_time),
+		classify_time,
+		100 * classify_time / wall_time);
+
+	journal.print_stats();
+}
+
+
+
+/**
+ * Create a data iterator for a data directory.
+ *
+ * @param type
+ * @param path
+ */
+DataIterator * create_iterator(DataType type, const char *path)
+{
+	if ( type == DataType::Genome ) {
+		return new GenomeIterator(path);
+	}
+	else if ( type == DataType::GenomeBinary ) {
+		return new GenomeMatrixIterator(path);
+	}
+	else if ( type == DataType::Image ) {
+		return new ImageIterator(path);
+	}
+
+	return nullptr;
+}
+
+
+
+/**
+ * Print load statistics of a data iterator, if it has any.
+ *
+ * @param iter
+ */
+void print_data_stats(DataIterator *iter)
+{
+	GenomeMatrixIterator *genome_iter = dynamic_cast<GenomeMatrixIterator *>(iter);
+
+	if ( genome_iter != nullptr ) {
+		genome_iter->print_stats();
+	}
+}
+
+
+
+/**
+ * Fit a streaming LDA layer on a training set which is read from
+ * a packed genome matrix in batches, so that the layer is fitted
+ * without forming the whole training set. The model still loads
+ * the whole training set afterwards to project it and fit the
+ * classifier, so this does not reduce peak memory.
+ *
+ * Like the data that the model passes to a feature layer, each
+ * batch is centered by the mean of the training set, and its
+ * labels are the indices of the classes of the training set. The
+ * PCA stage is fitted on the first batch. A CSR matrix is read as sparse batches, which are
+ * centered implicitly and are never expanded.
+ *
+ * @param stream_lda
+ * @param iter
+ * @param train_set
+ * @param batch
+ */
+void fit_lda_batched(StreamLDALayer *stream_lda, GenomeMatrixIterator *iter, const Dataset& train_set, int batch)
+{
+	const std::vector<std::string>& classes = train_set.classes();
+	std::vector<float> mean = iter->mean();
+	int n = iter->num_samples();
+
+	for ( int i = 0; i < n; i += batch ) {
+		int n_b = std::min(batch, n - i);
+		std::vector<int> y_b(n_b);
+
+		for ( int q = 0; q < n_b; q++ ) {
+			const std::string& label = iter->entries()[i + q].label;
+
+			y_b[q] = std::find(classes.begin(), classes.end(), label) - classes.begin();
+		}
+
+		if ( iter->sparse() ) {
+			stream_lda->partial_fit(iter->sparse_batch(i, n_b), mean, y_b);
+			continue;
+		}
+
+		Matrix X_b(iter->sample_size(), n_b);
+
+		iter->load_batch(X_b, i);
+
+		for ( int q = 0; q < n_b; q++ ) {
+			for ( int j = 0; j < X_b.rows(); j++ ) {
+				X_b.elem(j, q) -= mean[j];
+			}
+		}
+
+		stream_lda->partial_fit(X_b, y_b);
+	}
+
+	stream_lda->solve();
+}
+
+
+
+typedef struct {
+	FeatureType feature_type;
+	ClassifierType classifier_type;
+	float accuracy;
+	float fit_time;
+	float train_time;
+	float predict_time;
+} grid_result_t;
+
+
+
+/**
+ * Evaluate every combination of the feature layers and classifier
+ * layers in the grid on a training set and a test set.
+ *
+ * Each feature layer is fitted once by a model whose classifier is a
+ * grid layer, so the data are labelled and centered by the model as
+ * usual, and the classifiers of the feature layer are trained and
+ * evaluated on the shared projections. Only the classifiers which are
+ * implemented in this program run concurrently; mlearn classifiers
+ * and the feature layers run sequentially, since mlearn is not
+ * thread-safe.
+ *
+ * @param args
+ */
+void evaluate_grid(const optarg_t& args)
+{
+	// load training set and test set
+	std::unique_ptr<DataIterator> train_iter(create_iterator(args.data_type, args.path_train));
+	std::unique_ptr<DataIterator> test_iter(create_iterator(args.data_type, args.path_test));
+
+	Dataset train_set(train_iter.get());
+	Dataset test_set(test_iter.get());
+
+	print_data_stats(train_iter.get());
+	print_data_stats(test_iter.get());
+
+	// evaluate each feature layer
+	std::vector<grid_result_t> results;
+
+	for ( FeatureType feature_type : args.grid_features ) {
+		std::unique_ptr<FeatureLayer> feature(create_feature(args, feature_type));
+
+		if ( feature && args.path_cache != nullptr ) {
+			feature.reset(new CachedFeatureLayer(feature.release(), args.path_cache, feature_key(args, feature_type)));
+		}
+
+		std::vector<ClassifierLayer *> classifiers;
+
+		for ( ClassifierType classifier_type : args.grid_classifiers ) {
+			classifiers.push_back(create_classifier(args, classifier_type));
+		}
+
+		GridLayer grid(classifiers);
+		ClassificationModel model(feature.get(), &grid);
+
+		// fit the feature layer and evaluate each classifier
+		auto start = std::chrono::steady_clock::now();
+
+		model.fit(train_set);
+		model.predict(test_set);
+
+		float fit_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() - grid.eval_time();
+
+		for ( size_t k = 0; k < classifiers.size(); k++ ) {
+			const grid_eval_t& eval = grid.evals()[k];
+			int num_correct = 0;
+
+			for ( size_t i = 0; i < eval.y_pred.size(); i++ ) {
+				if ( eval.y_pred[i] >= 0 && train_set.classes()[eval.y_pred[i]] == test_set.entries()[i].label ) {
+					num_correct++;
+				}
+			}
+
+			results.push_back(grid_result_t {
+				feature_type,
+				args.grid_classifiers[k],
+				(float) num_correct / eval.y_pred.size(),
+				fit_time,
+				eval.train_time,
+				eval.predict_time
+			});
+		}
+	}
+
+	// print results table
+	for ( const grid_result_t& result : results ) {
+		std::cout
+			<< std::left
+			<< std::setw(10) << get_name(feature_types, result.feature_type)
+			<< std::setw(10) << get_name(classifier_types, result.classifier_type)
+			<< std::right << std::fixed
+			<< std::setw(8) << std::setprecision(3) << 100 * result.accuracy
+			<< std::setw(10) << std::setprecision(3) << result.fit_time
+			<< std::setw(10) << std::setprecision(3) << result.train_time
+			<< std::setw(10) << std::setprecision(3) << result.predict_time
+			<< "\n";
+	}
+}
+
+
+
+/**
+ * Truncate a fitted feature layer to its first n dimensions.
+ * Returns false if the layer does not support truncation.
+ *
+ * @param feature
+ * @param n
+ */
+bool truncate_feature(FeatureLayer *feature, int n)
+{
+	LanczosPCALayer *lanczos_pca = dynamic_cast<LanczosPCALayer *>(feature);
+	StreamLDALayer *stream_lda = dynamic_cast<StreamLDALayer *>(feature);
+	PCA2DLayer *pca2d = dynamic_cast<PCA2DLayer *>(feature);
+	RandomProjectionLayer *rp = dynamic_cast<RandomProjectionLayer *>(feature);
+
+	if ( lanczos_pca != nullptr ) {
+		lanczos_pca->truncate(n);
+	}
+	else if ( stream_lda != nullptr ) {
+		stream_lda->truncate(n);
+	}
+	else if ( pca2d != nullptr ) {
+		pca2d->truncate(n);
+	}
+	else if ( rp != nullptr ) {
+		rp->truncate(n);
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * Truncate the feature layer of a saved model without fitting
+ * it again. The truncated layer is frozen, so that fitting the
+ * model only projects the training set and fits the classifier,
+ * and the model is saved in place.
+ *
+ * @param args
+ */
+void truncate_model(const optarg_t& args)
+{
+	std::unique_ptr<FeatureLayer> feature(create_feature(args, args.feature_type));
+	std::unique_ptr<ClassifierLayer> classifier(create_classifier(args, args.classifier_type));
+
+	// load the saved model
+	ClassificationModel model(feature.get(), classifier.get());
+
+	model.load(args.path_model);
+
+	// truncate the feature layer
+	auto start = std::chrono::steady_clock::now();
+
+	if ( !feature || !truncate_feature(feature.get(), args.truncate) ) {
+		std::cerr << "error: --truncate requires --feat pca with --solver lanczos or --pca_energy, streaming lda, rp or 2dpca\n";
+		exit(1);
+	}
+
+	// fit the model with the frozen layer
+	std::unique_ptr<DataIterator> data_iter(create_iterator(args.data_type, args.path_train));
+	Dataset train_set(data_iter.get());
+	FrozenFeatureLayer frozen(feature.get());
+	ClassificationModel truncated(&frozen, classifier.get());
+
+	truncated.fit(train_set);
+	truncated.save(args.path_model);
+
+	auto end = std::chrono::steady_clock::now();
+
+	log(LogLevel::Info, "truncate: %s to %d dimensions in %.3f s",
+		args.path_model,
+		args.truncate,
+		std::chrono::duration<float>(end - start).count());
+}
+
+
+
+int main(int argc, char **argv)
+{
+	// parse command-line arguments
+	optarg_t args = parse_args(argc, argv);
+
+	// validate arguments
+	validate_args(args);
+
+	// initialize random number engine
+	Random::seed();
+
+	// set the number of threads of the rank-k update
+	LINALG_THREADS = args.threads;
+
+	// evaluate a grid of layers if specified
+	if ( !args.grid_features.empty() ) {
+		evaluate_grid(args);
+		return 0;
+	}
+
+	// truncate a saved model if specified
+	if ( args.truncate > 0 ) {
+		truncate_model(args);
+		return 0;
+	}
+
+	// initialize feature layer
+	std::unique_ptr<FeatureLayer> feature(create_feature(args, args.feature_type));
+	StreamLDALayer *stream_lda = dynamic_cast<StreamLDALayer *>(feature.get());
+	CheckpointICALayer *checkpoint_ica = dynamic_cast<CheckpointICALayer *>(feature.get());
+	PCA2DLayer *pca2d = dynamic_cast<PCA2DLayer *>(feature.get());
+	LBPLayer *lbp = dynamic_cast<LBPLayer *>(feature.get());
+	LanczosPCALayer *lanczos_pca = dynamic_cast<LanczosPCALayer *>(feature.get());
+
+	// wrap feature layer with the cache
+	CachedFeatureLayer *cache = nullptr;
+
+	if ( feature && args.path_cache != nullptr ) {
+		cache = new CachedFeatureLayer(feature.release(), args.path_cache, feature_key(args, args.feature_type));
+		feature.reset(cache);
+	}
+
+	// the cascade classifier uses the feature layers of both of its
+	// stages, which replace the identity layer of the model
+	if ( args.classifier_type == ClassifierType::Cascade ) {
+		feature.reset(new CascadeFeatureLayer(
+			create_feature(args, args.cascade_coarse),
+			create_feature(args, args.cascade_fine)
 		));
 	}
 
 	// initialize classifier layer
-	std::unique_ptr<ClassifierLayer> classifier;
+	std::unique_ptr<ClassifierLayer> classifier(create_classifier(args, args.classifier_type, feature.get()));
+	MatchLayer *matcher = dynamic_cast<MatchLayer *>(classifier.get());
 
-	if ( args.classifier_type == ClassifierType::KNN ) {
-		classifier.reset(new KNNLayer(args.knn_k, args.knn_dist));
+	// initialize training data iterator
+	std::unique_ptr<DataIterator> train_iter;
+
+	if ( args.train ) {
+		train_iter.reset(create_iterator(args.data_type, args.path_train));
 	}
-	else if ( args.classifier_type == ClassifierType::Bayes ) {
-		classifier.reset(new BayesLayer());
+
+	// fit a streaming LDA layer in batches if the training data can be
+	// read in batches, in which case the model only fits the classifier;
+	// the model still loads the whole training set to do so
+	GenomeMatrixIterator *genome_iter = dynamic_cast<GenomeMatrixIterator *>(train_iter.get());
+	std::unique_ptr<FrozenFeatureLayer> frozen;
+
+	if ( stream_lda != nullptr && cache == nullptr && genome_iter != nullptr && args.lda_batch > 0 ) {
+		frozen.reset(new FrozenFeatureLayer(feature.get()));
 	}
 
 	// initialize model
-	ClassificationModel model(feature.get(), classifier.get());
+	ClassificationModel model(frozen ? frozen.get() : feature.get(), classifier.get());
 
 	// run the face recognition system
 	if ( args.train ) {
-		// initialize data iterator
-		std::unique_ptr<DataIterator> data_iter;
-
-		if ( args.data_type == DataType::Genome ) {
-			data_iter.reset(new GenomeIterator(args.path_train));
-		}
-		else if ( args.data_type == DataType::Image ) {
-			data_iter.reset(new ImageIterator(args.path_train));
-		}
-
 		// train model with training set
-		Dataset train_set(data_iter.get());
+		Dataset train_set(train_iter.get());
 
 		model.print();
+
+		if ( frozen ) {
+			fit_lda_batched(stream_lda, genome_iter, train_set, args.lda_batch);
+		}
+
 		model.fit(train_set);
+
+		print_data_stats(train_iter.get());
 	}
 	else {
 		model.load(args.path_model);
 		model.print();
 	}
 
-	if ( args.test ) {
-		// initialize data iterator
-		std::unique_ptr<DataIterator> data_iter;
-
-		if ( args.data_type == DataType::Genome ) {
-			data_iter.reset(new GenomeIterator(args.path_test));
+	// face crops must have the image shape of an image feature layer
+	if ( args.stream || args.path_scan != nullptr || args.path_replay != nullptr ) {
+		if ( pca2d != nullptr ) {
+			check_face_shape("2D-PCA", pca2d->width(), pca2d->height());
 		}
-		else if ( args.data_type == DataType::Image ) {
-			data_iter.reset(new ImageIterator(args.path_test));
+
+		if ( lbp != nullptr ) {
+			check_face_shape("LBP", lbp->width(), lbp->height());
 		}
+	}
+
+	if ( args.test ) {
+		// initialize data iterator
+		std::unique_ptr<DataIterator> data_iter(create_iterator(args.data_type, args.path_test));
 
 		// evaluate model with the test set
 		Dataset test_set(data_iter.get());
 
 		std::vector<int> y_pred = model.predict(test_set);
 
-		model.score(test_set, y_pred);
-		model.print_results(test_set, y_pred);
+		print_data_stats(data_iter.get());
+
+		// the closed-set score would count rejections as errors
+		if ( args.reject_threshold > 0 ) {
+			print_rejected(test_set, model.train_set().classes(), y_pred);
+		}
+		else {
+			model.score(test_set, y_pred);
+			model.print_results(test_set, y_pred);
+		}
+	}
+	else if ( args.path_replay != nullptr ) {
+		replay(args, model, matcher);
 	}
 	else if ( args.stream ) {
-		stream(args.stream_dev, model);
+		stream(args, model, matcher);
+	}
+	else if ( args.path_scan != nullptr ) {
+		// the scan journal records the hash of the model file,
+		// so a model which was just trained is saved first
+		if ( args.train ) {
+			model.save(args.path_model);
+		}
+
+		scan(args, model, matcher);
 	}
 	else {
 		model.save(args.path_model);
@@ -562,5 +2327,29 @@ int main(int argc, char **argv)
 
 	model.print_stats();
 
+	if ( cache != nullptr ) {
+		cache->print_stats();
+	}
+
+	if ( stream_lda != nullptr ) {
+		stream_lda->print_stats();
+	}
+
+	if ( checkpoint_ica != nullptr ) {
+		checkpoint_ica->print_stats();
+	}
+
+	if ( lbp != nullptr ) {
+		lbp->print_stats();
+	}
+
+	if ( lanczos_pca != nullptr ) {
+		lanczos_pca->print_stats();
+	}
+
+	if ( matcher != nullptr ) {
+		matcher->print_stats();
+	}
+
 	return 0;
 }
@@ -0,0 +1,129 @@
+/**
+ * @file matchcache.cpp
+ *
+ * Implementation of the match cache.
+ *
+ * The cache remembers the classification results of recent face
+ * crops by their perceptual hash. A subject who stands still in front
+ * of the camera produces nearly identical crops on every frame, whose
+ * hashes differ in only a few bits, so the result of the first crop
+ * can be reused for the following ones instead of classifying each of
+ * them. A cached result expires a fixed number of frames after it was
+ * computed, so that the label of a subject is still refreshed
+ * periodically. The cache holds few entries, so it is searched
+ * linearly.
+ */
+#include <algorithm>
+#include <mlearn.h>
+#include "matchcache.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a match cache.
+ *
+ * @param radius
+ * @param ttl
+ * @param capacity
+ */
+MatchCache::MatchCache(int radius, int ttl, int capacity)
+{
+	_radius = radius;
+	_ttl = ttl;
+	_capacity = capacity;
+
+	_num_lookups = 0;
+	_num_hits = 0;
+	_num_expired = 0;
+}
+
+
+
+/**
+ * Find the cached result of the closest crop within the Hamming
+ * radius of a hash. Expired entries are removed first. Returns
+ * false if there is no such crop.
+ *
+ * @param hash
+ * @param frame
+ * @param match
+ */
+bool MatchCache::lookup(uint64_t hash, int frame, Match& match)
+{
+	_num_lookups++;
+
+	// remove expired entries
+	auto expired = std::remove_if(_entries.begin(), _entries.end(), [&] (const match_entry_t& entry) {
+		return frame - entry.frame >= _ttl;
+	});
+
+	_num_expired += _entries.end() - expired;
+	_entries.erase(expired, _entries.end());
+
+	// find the closest entry
+	int best = -1;
+	int best_dist = _radius + 1;
+
+	for ( size_t i = 0; i < _entries.size(); i++ ) {
+		int dist = __builtin_popcountll(hash ^ _entries[i].hash);
+
+		if ( dist < best_dist ) {
+			best = i;
+			best_dist = dist;
+		}
+	}
+
+	if ( best == -1 ) {
+		return false;
+	}
+
+	match = _entries[best].match;
+	_num_hits++;
+
+	return true;
+}
+
+
+
+/**
+ * Add the result of a crop to the cache, replacing the
+ * oldest entry if the cache is full.
+ *
+ * @param hash
+ * @param frame
+ * @param match
+ */
+void MatchCache::insert(uint64_t hash, int frame, const Match& match)
+{
+	if ( _entries.size() >= _capacity ) {
+		auto oldest = std::min_element(_entries.begin(), _entries.end(), [] (const match_entry_t& a, const match_entry_t& b) {
+			return a.frame < b.frame;
+		});
+
+		_entries.erase(oldest);
+	}
+
+	_entries.push_back(match_entry_t { hash, match, frame });
+}
+
+
+
+/**
+ * Print cache statistics.
+ */
+void MatchCache::print_stats()
+{
+	if ( _num_lookups == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "hash cache: %ld lookups, %ld hits (%.1f%%), %ld expired",
+		_num_lookups,
+		_num_hits,
+		100.0f * _num_hits / _num_lookups,
+		_num_expired);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file matchcache.h
+ *
+ * Interface definitions for the match cache.
+ */
+#ifndef MATCHCACHE_H
+#define MATCHCACHE_H
+
+#include <cstdint>
+#include <vector>
+#include "matchlayer.h"
+
+
+
+typedef struct {
+	uint64_t hash;
+	Match match;
+	int frame;
+} match_entry_t;
+
+
+
+class MatchCache {
+private:
+	int _radius;
+	int _ttl;
+	size_t _capacity;
+	std::vector<match_entry_t> _entries;
+
+	long _num_lookups;
+	long _num_hits;
+	long _num_expired;
+
+public:
+	MatchCache(int radius, int ttl, int capacity=256);
+
+	bool lookup(uint64_t hash, int frame, Match& match);
+	void insert(uint64_t hash, int frame, const Match& match);
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file matchlayer.h
+ *
+ * Interface definitions for classifier layers which report
+ * match distances in addition to predicted labels.
+ */
+#ifndef MATCHLAYER_H
+#define MATCHLAYER_H
+
+#include <mlearn.h>
+#include <vector>
+
+
+
+/**
+ * Distance functions of match layers. CHI2 is the chi-square
+ * distance between histograms, which assumes non-negative
+ * features.
+ */
+enum class MatchDist {
+	None,
+	COS,
+	L1,
+	L2,
+	CHI2
+};
+
+
+
+/**
+ * Result of classifying a single sample. The label is the
+ * index of the predicted class, or -1 if the sample was
+ * rejected as unknown. The margin is the gap between the
+ * distance to the predicted class and the distance to the
+ * nearest competing class.
+ */
+typedef struct {
+	int y;
+	float dist;
+	float margin;
+} Match;
+
+
+
+class MatchLayer : public ML::ClassifierLayer {
+protected:
+	std::vector<Match> _matches;
+
+public:
+	virtual ~MatchLayer() {};
+
+	const std::vector<Match>& matches() const { return _matches; }
+
+	virtual void print_stats() = 0;
+};
+
+
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * @file motiondetector.cpp
+ *
+ * Implementation of the motion detector.
+ *
+ * The detector maintains a running-average background model of a
+ * downscaled grayscale frame. Each new frame is compared with the
+ * background, and the pixels which differ by more than a threshold
+ * are grouped into regions of motion. Face detection can then be
+ * restricted to these regions, or skipped entirely when nothing has
+ * moved. A full scan is still requested periodically, so that faces
+ * which entered the scene without triggering motion are not missed.
+ */
+#include <algorithm>
+#include <mlearn.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "motiondetector.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a motion detector.
+ *
+ * @param scale
+ * @param interval
+ */
+MotionDetector::MotionDetector(int scale, int interval)
+{
+	_scale = scale;
+	_interval = interval;
+	_alpha = 0.05;
+	_threshold = 25;
+	_min_area = 4;
+
+	_frames_since_scan = 0;
+
+	_num_frames = 0;
+	_num_full = 0;
+	_num_motion = 0;
+	_num_static = 0;
+}
+
+
+
+/**
+ * Merge overlapping regions into their bounding rectangles.
+ *
+ * @param regions
+ */
+std::vector<cv::Rect> MotionDetector::merge_regions(std::vector<cv::Rect> regions) const
+{
+	bool merged = true;
+
+	while ( merged ) {
+		merged = false;
+
+		for ( size_t i = 0; i < regions.size() && !merged; i++ ) {
+			for ( size_t j = i + 1; j < regions.size(); j++ ) {
+				if ( (regions[i] & regions[j]).area() > 0 ) {
+					regions[i] = regions[i] | regions[j];
+					regions.erase(regions.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	return regions;
+}
+
+
+
+/**
+ * Update the background model with a frame and compute the regions
+ * of the frame which contain motion. Returns true if the whole frame
+ * should be scanned instead, which happens on the first frame, after
+ * the full-scan interval, and when most of the frame has changed
+ * (for example due to a change in lighting).
+ *
+ * @param frame
+ * @param regions
+ */
+bool MotionDetector::update(const cv::Mat& frame, std::vector<cv::Rect>& regions)
+{
+	const double MAX_MOTION = 0.5;
+	const int PADDING = 2;
+	const int MIN_REGION = 64;
+
+	_num_frames++;
+	regions.clear();
+
+	// compute downscaled grayscale frame
+	cv::Mat gray;
+	cv::Mat small;
+
+	cv::cvtColor(frame, gray, CV_BGR2GRAY);
+	cv::resize(gray, small, cv::Size(frame.cols / _scale, frame.rows / _scale), 0, 0, cv::INTER_AREA);
+	cv::GaussianBlur(small, small, cv::Size(5, 5), 0);
+
+	// initialize background model on the first frame
+	if ( _background.empty() ) {
+		small.convertTo(_background, CV_32F);
+		_frames_since_scan = 0;
+		_num_full++;
+		return true;
+	}
+
+	// compute foreground mask
+	cv::Mat background;
+	cv::Mat mask;
+
+	cv::convertScaleAbs(_background, background);
+	cv::absdiff(small, background, mask);
+	cv::threshold(mask, mask, _threshold, 255, cv::THRESH_BINARY);
+	cv::dilate(mask, mask, cv::Mat());
+	cv::accumulateWeighted(small, _background, _alpha);
+
+	// perform a full scan periodically or on global change
+	_frames_since_scan++;
+
+	if ( _frames_since_scan >= _interval || cv::countNonZero(mask) > MAX_MOTION * mask.rows * mask.cols ) {
+		_frames_since_scan = 0;
+		_num_full++;
+		return true;
+	}
+
+	// extract regions of motion in frame coordinates
+	std::vector<std::vector<cv::Point>> contours;
+
+	cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+	cv::Rect bounds(0, 0, frame.cols, frame.rows);
+
+	for ( auto& contour : contours ) {
+		cv::Rect r = cv::boundingRect(contour);
+
+		if ( r.area() < _min_area ) {
+			continue;
+		}
+
+		// pad the region, since a face is usually larger than
+		// the part of it that moved, and the cascade needs some
+		// context around the face
+		int pad_x = std::max(PADDING * r.width * _scale, (MIN_REGION - r.width * _scale) / 2);
+		int pad_y = std::max(PADDING * r.height * _scale, (MIN_REGION - r.height * _scale) / 2);
+
+		cv::Rect region(
+			r.x * _scale - pad_x,
+			r.y * _scale - pad_y,
+			r.width * _scale + 2 * pad_x,
+			r.height * _scale + 2 * pad_y
+		);
+
+		regions.push_back(region & bounds);
+	}
+
+	regions = merge_regions(regions);
+
+	if ( regions.empty() ) {
+		_num_static++;
+	}
+	else {
+		_num_motion++;
+	}
+
+	return false;
+}
+
+
+
+/**
+ * Print motion statistics.
+ */
+void MotionDetector::print_stats()
+{
+	if ( _num_frames == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "motion: %d frames, %d full scans, %d motion scans, %d skipped (%.1f%%)",
+		_num_frames,
+		_num_full,
+		_num_motion,
+		_num_static,
+		100.0f * _num_static / _num_frames);
+}
@@ -0,0 +1,42 @@
+/**
+ * @file motiondetector.h
+ *
+ * Interface definitions for the motion detector.
+ */
+#ifndef MOTIONDETECTOR_H
+#define MOTIONDETECTOR_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+
+
+class MotionDetector {
+private:
+	int _scale;
+	int _interval;
+	double _alpha;
+	double _threshold;
+	int _min_area;
+
+	cv::Mat _background;
+	int _frames_since_scan;
+
+	int _num_frames;
+	int _num_full;
+	int _num_motion;
+	int _num_static;
+
+	std::vector<cv::Rect> merge_regions(std::vector<cv::Rect> regions) const;
+
+public:
+	MotionDetector(int scale, int interval);
+
+	bool update(const cv::Mat& frame, std::vector<cv::Rect>& regions);
+
+	void print_stats();
+};
+
+
+
+#endif
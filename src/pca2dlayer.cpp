@@ -0,0 +1,256 @@
+/**
+ * @file pca2dlayer.cpp
+ *
+ * Implementation of the 2D-PCA feature layer.
+ *
+ * 2D-PCA (Yang et al., 2004) treats each face as a matrix A rather
+ * than a vector, and computes the eigenvectors of the image covariance
+ * matrix G = 1/N * sum((A - mean)' * (A - mean)), which is only
+ * width x width. For a 128 x 128 face this is a 128 x 128 eigenproblem
+ * instead of a 16384 x 16384 one, so the fit is cheap even when
+ * the training set is large. A face is projected by multiplying its
+ * image matrix by the top n eigenvectors, which yields n values for
+ * every image row.
+ *
+ * Samples are stored in the row-major, channel-interleaved layout of
+ * BBoxIterator and of the image iterator, so the image matrix of a
+ * color image has one row per image row and channel.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include "bboxiterator.h"
+#include "linalg.h"
+#include "pca2dlayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a 2D-PCA layer. If the width and height are zero,
+ * the images are assumed to be square.
+ *
+ * @param n
+ * @param width
+ * @param height
+ */
+PCA2DLayer::PCA2DLayer(int n, int width, int height)
+{
+	_n = n;
+	_width = width;
+	_height = height;
+	_channels = 0;
+}
+
+
+
+/**
+ * Compute the mean image and the projection axes of
+ * a training set.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void PCA2DLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	if ( !image_shape(X.rows(), _width, _height, _channels) ) {
+		std::cerr << "error: samples of size " << X.rows() << " do not match the image shape of 2D-PCA, use --image_width and --image_height\n";
+		exit(1);
+	}
+
+	int N = X.cols();
+	int w = _width;
+	int num_rows = _height * _channels;
+
+	// compute the mean image
+	std::vector<double> mean(X.rows(), 0.0);
+
+	for ( int q = 0; q < N; q++ ) {
+		for ( int i = 0; i < X.rows(); i++ ) {
+			mean[i] += X.elem(i, q);
+		}
+	}
+
+	_mean.resize(X.rows());
+
+	for ( int i = 0; i < X.rows(); i++ ) {
+		_mean[i] = mean[i] / N;
+	}
+
+	// compute the upper triangle of the image covariance matrix,
+	// with the centered image rows of a batch of images at a time
+	const int BATCH = 64;
+
+	std::vector<double> G((size_t) w * w, 0.0);
+	std::vector<float> rows((size_t) BATCH * num_rows * w);
+
+	for ( int q0 = 0; q0 < N; q0 += BATCH ) {
+		int n_b = std::min(BATCH, N - q0);
+
+		for ( int q = 0; q < n_b; q++ ) {
+			for ( int a = 0; a < num_rows; a++ ) {
+				float *row = &rows[((size_t) q * num_rows + a) * w];
+				int offset = (a / _channels) * w * _channels + a % _channels;
+
+				for ( int j = 0; j < w; j++ ) {
+					int i = offset + j * _channels;
+
+					row[j] = X.elem(i, q0 + q) - _mean[i];
+				}
+			}
+		}
+
+		sym_rank_k(rows.data(), n_b * num_rows, w, G);
+	}
+
+	for ( int i = 0; i < w; i++ ) {
+		for ( int j = i; j < w; j++ ) {
+			G[(size_t) i * w + j] /= N;
+		}
+	}
+
+	sym_fill_lower(G, w);
+
+	// compute the top eigenvectors
+	std::vector<double> evals;
+
+	sym_eigen(G, w, evals);
+
+	int n = std::min(_n, w);
+
+	_W.resize((size_t) n * w);
+
+	for ( int k = 0; k < n; k++ ) {
+		for ( int j = 0; j < w; j++ ) {
+			_W[(size_t) k * w + j] = G[(size_t) j * w + k];
+		}
+	}
+}
+
+
+
+/**
+ * Project a matrix onto the projection axes. Row a of the
+ * image matrix of a sample is mapped to rows a * n to
+ * a * n + n - 1 of the projection.
+ *
+ * @param X
+ */
+Matrix PCA2DLayer::project(const Matrix& X)
+{
+	assert(X.rows() == (int) _mean.size());
+
+	int w = _width;
+	int n = _W.size() / w;
+	int num_rows = _height * _channels;
+	Matrix P(num_rows * n, X.cols());
+	std::vector<float> row(w);
+
+	for ( int q = 0; q < X.cols(); q++ ) {
+		for ( int a = 0; a < num_rows; a++ ) {
+			int offset = (a / _channels) * w * _channels + a % _channels;
+
+			for ( int j = 0; j < w; j++ ) {
+				int i = offset + j * _channels;
+
+				row[j] = X.elem(i, q) - _mean[i];
+			}
+
+			for ( int k = 0; k < n; k++ ) {
+				const float *W_k = &_W[(size_t) k * w];
+				float sum = 0;
+
+				for ( int j = 0; j < w; j++ ) {
+					sum += W_k[j] * row[j];
+				}
+
+				P.elem(a * n + k, q) = sum;
+			}
+		}
+	}
+
+	return P;
+}
+
+
+
+/**
+ * Save a 2D-PCA layer to a file.
+ *
+ * @param file
+ */
+void PCA2DLayer::save(std::ofstream& file)
+{
+	int num_dims = _mean.size();
+	int n = _W.size() / _width;
+
+	file.write(reinterpret_cast<const char *>(&_n), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_width), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_height), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_channels), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&num_dims), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&n), sizeof(int));
+
+	file.write(reinterpret_cast<const char *>(_mean.data()), _mean.size() * sizeof(float));
+	file.write(reinterpret_cast<const char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Load a 2D-PCA layer from a file.
+ *
+ * @param file
+ */
+void PCA2DLayer::load(std::ifstream& file)
+{
+	int num_dims;
+	int n;
+
+	file.read(reinterpret_cast<char *>(&_n), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_width), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_height), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_channels), sizeof(int));
+	file.read(reinterpret_cast<char *>(&num_dims), sizeof(int));
+	file.read(reinterpret_cast<char *>(&n), sizeof(int));
+
+	_mean.resize(num_dims);
+	file.read(reinterpret_cast<char *>(_mean.data()), _mean.size() * sizeof(float));
+
+	_W.resize((size_t) n * _width);
+	file.read(reinterpret_cast<char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Truncate a 2D-PCA layer to its first n projection axes.
+ *
+ * @param n
+ */
+void PCA2DLayer::truncate(int n)
+{
+	int n_axes = std::min(n, (int) (_W.size() / _width));
+
+	_n = n_axes;
+	_W.resize((size_t) n_axes * _width);
+}
+
+
+
+/**
+ * Print information about a 2D-PCA layer.
+ */
+void PCA2DLayer::print()
+{
+	log(LogLevel::Verbose, "2D-PCA");
+	log(LogLevel::Verbose, "  %-20s  %10d", "n", _n);
+	log(LogLevel::Verbose, "  %-20s  %10d", "width", _width);
+	log(LogLevel::Verbose, "  %-20s  %10d", "height", _height);
+	log(LogLevel::Verbose, "");
+}
@@ -0,0 +1,44 @@
+/**
+ * @file pca2dlayer.h
+ *
+ * Interface definitions for the 2D-PCA feature layer.
+ */
+#ifndef PCA2DLAYER_H
+#define PCA2DLAYER_H
+
+#include <fstream>
+#include <mlearn.h>
+#include <vector>
+
+
+
+class PCA2DLayer : public ML::FeatureLayer {
+private:
+	int _n;
+	int _width;
+	int _height;
+	int _channels;
+
+	std::vector<float> _mean;
+	std::vector<float> _W;
+
+public:
+	PCA2DLayer(int n, int width, int height);
+	~PCA2DLayer() {};
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+	int channels() const { return _channels; }
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+	void truncate(int n);
+
+	void print();
+};
+
+
+
+#endif
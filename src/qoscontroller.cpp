@@ -0,0 +1,144 @@
+/**
+ * @file qoscontroller.cpp
+ *
+ * Implementation of the quality-of-service controller.
+ *
+ * The controller holds the processing cost of a video stream within
+ * the frame budget of a target frame rate. It measures the cost of
+ * each frame and moves along a ladder of operating points, from the
+ * most accurate (fine detection scale, full resolution, detection and
+ * classification on every frame) to the cheapest. When the average
+ * cost exceeds the budget it moves to a cheaper operating point, and
+ * when the cost is well below the budget it moves back to a more
+ * accurate one. Each move is followed by a hold-off period so that
+ * the average cost can settle before the next decision.
+ */
+#include <mlearn.h>
+#include "qoscontroller.h"
+
+
+
+using namespace ML;
+
+
+
+const operating_point_t OPERATING_POINTS[] = {
+	{ 1.1, 1, 1, 1 },
+	{ 1.2, 1, 1, 1 },
+	{ 1.3, 1, 1, 1 },
+	{ 1.3, 2, 1, 1 },
+	{ 1.3, 2, 1, 2 },
+	{ 1.4, 2, 2, 2 },
+	{ 1.4, 3, 2, 4 },
+	{ 1.5, 3, 3, 4 },
+	{ 1.5, 4, 4, 8 }
+};
+
+const int NUM_LEVELS = sizeof(OPERATING_POINTS) / sizeof(operating_point_t);
+const int DEFAULT_LEVEL = 2;
+
+
+
+/**
+ * Construct a quality-of-service controller. The controller
+ * starts at the default detection parameters.
+ *
+ * @param target_fps
+ */
+QoSController::QoSController(float target_fps)
+{
+	_budget = 1.0f / target_fps;
+	_cost = 0;
+	_frames_since_change = 0;
+
+	_num_frames = 0;
+	_num_adjustments = 0;
+	_num_over = 0;
+
+	_level = DEFAULT_LEVEL;
+	_point = OPERATING_POINTS[_level];
+}
+
+
+
+/**
+ * Move to another operating point and log the adjustment.
+ *
+ * @param level
+ */
+void QoSController::set_level(int level)
+{
+	_point = OPERATING_POINTS[level];
+
+	log(LogLevel::Info, "qos: cost %.1f ms, budget %.1f ms, level %d -> %d (scale %.1f, downscale %d, detect every %d, classify every %d)",
+		1000 * _cost,
+		1000 * _budget,
+		_level,
+		level,
+		_point.scale_factor,
+		_point.downscale,
+		_point.detect_interval,
+		_point.classify_interval);
+
+	_level = level;
+	_frames_since_change = 0;
+	_num_adjustments++;
+}
+
+
+
+/**
+ * Update the controller with the processing time of a frame.
+ *
+ * @param frame_time
+ */
+void QoSController::update(float frame_time)
+{
+	const float ALPHA = 0.1f;
+	const int HOLD_FRAMES = 15;
+	const float LOW_WATER = 0.5f;
+
+	_cost = (_num_frames == 0) ? frame_time : (1 - ALPHA) * _cost + ALPHA * frame_time;
+	_num_frames++;
+	_frames_since_change++;
+
+	if ( frame_time > _budget ) {
+		_num_over++;
+	}
+
+	if ( _frames_since_change < HOLD_FRAMES ) {
+		return;
+	}
+
+	if ( _cost > _budget && _level < NUM_LEVELS - 1 ) {
+		set_level(_level + 1);
+	}
+	else if ( _cost < LOW_WATER * _budget && _level > 0 ) {
+		set_level(_level - 1);
+	}
+}
+
+
+
+/**
+ * Print controller statistics and the current operating point.
+ */
+void QoSController::print_stats()
+{
+	if ( _num_frames == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "qos: %d frames, %d adjustments, %.1f%% over budget, average cost %.1f ms, budget %.1f ms",
+		_num_frames,
+		_num_adjustments,
+		100.0f * _num_over / _num_frames,
+		1000 * _cost,
+		1000 * _budget);
+	log(LogLevel::Info, "qos: level %d (scale %.1f, downscale %d, detect every %d, classify every %d)",
+		_level,
+		_point.scale_factor,
+		_point.downscale,
+		_point.detect_interval,
+		_point.classify_interval);
+}
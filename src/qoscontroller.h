@@ -0,0 +1,47 @@
+/**
+ * @file qoscontroller.h
+ *
+ * Interface definitions for the quality-of-service controller.
+ */
+#ifndef QOSCONTROLLER_H
+#define QOSCONTROLLER_H
+
+
+
+typedef struct {
+	double scale_factor;
+	int downscale;
+	int detect_interval;
+	int classify_interval;
+} operating_point_t;
+
+
+
+class QoSController {
+private:
+	float _budget;
+	float _cost;
+	int _level;
+	int _frames_since_change;
+
+	int _num_frames;
+	int _num_adjustments;
+	int _num_over;
+
+	operating_point_t _point;
+
+	void set_level(int level);
+
+public:
+	QoSController(float target_fps);
+
+	const operating_point_t& point() const { return _point; }
+
+	void update(float frame_time);
+
+	void print_stats();
+};
+
+
+
+#endif
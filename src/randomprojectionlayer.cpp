@@ -0,0 +1,233 @@
+/**
+ * @file randomprojectionlayer.cpp
+ *
+ * Implementation of the random projection layer.
+ *
+ * The layer projects samples onto n random directions, which by the
+ * Johnson-Lindenstrauss lemma approximately preserves the distances
+ * between samples, so it can replace PCA in front of a distance-based
+ * classifier without any fitting. The projection matrix is very sparse
+ * (Li et al., 2006): each element is +sqrt(s) or -sqrt(s) with
+ * probability 1/(2s) each and zero otherwise, where s = sqrt(D) for
+ * D input dimensions. Only the positions of the nonzero elements are
+ * stored, so a projection costs about n * sqrt(D) additions per
+ * sample instead of n * D multiply-adds.
+ *
+ * The matrix is generated from a seed with a self-contained random
+ * number generator, so that the same seed produces the same matrix
+ * with any standard library, and the model file only stores the seed.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "randomprojectionlayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Generate the next value of a splitmix64 sequence.
+ *
+ * @param state
+ */
+inline uint64_t splitmix64(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+
+
+/**
+ * Generate a uniform random number in (0, 1].
+ *
+ * @param state
+ */
+inline double uniform(uint64_t& state)
+{
+	return ((splitmix64(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+
+
+/**
+ * Construct a random projection layer.
+ *
+ * @param n
+ * @param seed
+ */
+RandomProjectionLayer::RandomProjectionLayer(int n, uint64_t seed)
+{
+	_n = n;
+	_seed = seed;
+	_num_dims = 0;
+	_density = 0;
+	_scale = 0;
+}
+
+
+
+/**
+ * Generate the sparse projection matrix from the seed. The
+ * nonzero positions of each row are found by skipping ahead
+ * a geometric number of zeros at a time, so the cost is
+ * proportional to the number of nonzeros.
+ */
+void RandomProjectionLayer::generate()
+{
+	float s = sqrtf(_num_dims);
+	double log_q = log(1 - 1 / s);
+
+	_density = 1 / s;
+	_scale = sqrtf(s / _n);
+
+	_pos_ptr.assign(1, 0);
+	_neg_ptr.assign(1, 0);
+	_pos_idx.clear();
+	_neg_idx.clear();
+
+	uint64_t state = _seed;
+
+	for ( int i = 0; i < _n; i++ ) {
+		long j = -1;
+
+		while ( true ) {
+			j += 1 + (long) floor(log(uniform(state)) / log_q);
+
+			if ( j >= _num_dims ) {
+				break;
+			}
+
+			if ( splitmix64(state) & 1 ) {
+				_pos_idx.push_back(j);
+			}
+			else {
+				_neg_idx.push_back(j);
+			}
+		}
+
+		_pos_ptr.push_back(_pos_idx.size());
+		_neg_ptr.push_back(_neg_idx.size());
+	}
+}
+
+
+
+/**
+ * Generate the projection matrix for the dimensions of a
+ * training set. There is nothing to fit.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void RandomProjectionLayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	_num_dims = X.rows();
+
+	generate();
+}
+
+
+
+/**
+ * Project a matrix by the sparse projection matrix.
+ *
+ * @param X
+ */
+Matrix RandomProjectionLayer::project(const Matrix& X)
+{
+	assert(X.rows() == _num_dims);
+
+	Matrix P(_n, X.cols());
+	std::vector<float> x(_num_dims);
+
+	for ( int k = 0; k < X.cols(); k++ ) {
+		for ( int j = 0; j < _num_dims; j++ ) {
+			x[j] = X.elem(j, k);
+		}
+
+		for ( int i = 0; i < _n; i++ ) {
+			float sum = 0;
+
+			for ( int p = _pos_ptr[i]; p < _pos_ptr[i + 1]; p++ ) {
+				sum += x[_pos_idx[p]];
+			}
+
+			for ( int p = _neg_ptr[i]; p < _neg_ptr[i + 1]; p++ ) {
+				sum -= x[_neg_idx[p]];
+			}
+
+			P.elem(i, k) = _scale * sum;
+		}
+	}
+
+	return P;
+}
+
+
+
+/**
+ * Save a random projection layer to a file. Only the seed
+ * and the dimensions are stored.
+ *
+ * @param file
+ */
+void RandomProjectionLayer::save(std::ofstream& file)
+{
+	file.write(reinterpret_cast<const char *>(&_n), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_seed), sizeof(uint64_t));
+	file.write(reinterpret_cast<const char *>(&_num_dims), sizeof(int));
+}
+
+
+
+/**
+ * Load a random projection layer from a file.
+ *
+ * @param file
+ */
+void RandomProjectionLayer::load(std::ifstream& file)
+{
+	file.read(reinterpret_cast<char *>(&_n), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_seed), sizeof(uint64_t));
+	file.read(reinterpret_cast<char *>(&_num_dims), sizeof(int));
+
+	generate();
+}
+
+
+
+/**
+ * Truncate a random projection layer to its first n
+ * projections. The rows are generated in order from the
+ * seed, so the remaining rows do not change, only the
+ * scale of the projection.
+ *
+ * @param n
+ */
+void RandomProjectionLayer::truncate(int n)
+{
+	_n = std::min(n, _n);
+
+	generate();
+}
+
+
+
+/**
+ * Print information about a random projection layer.
+ */
+void RandomProjectionLayer::print()
+{
+	log(LogLevel::Verbose, "Random projection");
+	log(LogLevel::Verbose, "  %-20s  %10d", "n", _n);
+	log(LogLevel::Verbose, "  %-20s  %10lu", "seed", (unsigned long) _seed);
+	log(LogLevel::Verbose, "  %-20s  %10f", "density", _density);
+	log(LogLevel::Verbose, "");
+}
@@ -0,0 +1,45 @@
+/**
+ * @file randomprojectionlayer.h
+ *
+ * Interface definitions for the random projection layer.
+ */
+#ifndef RANDOMPROJECTIONLAYER_H
+#define RANDOMPROJECTIONLAYER_H
+
+#include <cstdint>
+#include <mlearn.h>
+#include <vector>
+
+
+
+class RandomProjectionLayer : public ML::FeatureLayer {
+private:
+	int _n;
+	uint64_t _seed;
+	int _num_dims;
+	float _density;
+	float _scale;
+
+	std::vector<int> _pos_ptr;
+	std::vector<int> _pos_idx;
+	std::vector<int> _neg_ptr;
+	std::vector<int> _neg_idx;
+
+	void generate();
+
+public:
+	RandomProjectionLayer(int n, uint64_t seed);
+	~RandomProjectionLayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	ML::Matrix project(const ML::Matrix& X);
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+	void truncate(int n);
+
+	void print();
+};
+
+
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * @file scanjournal.cpp
+ *
+ * Implementation of the scan journal.
+ *
+ * The journal records the progress of a scan so that an interrupted
+ * scan can be resumed. The results of each file are appended to the
+ * output file, and then the file name is appended to the journal along
+ * with the size of the output file at that point. When a scan is
+ * resumed, the output file is truncated to the size recorded by the
+ * last complete journal entry, which discards the results of a file
+ * that was only partially written, and the files in the journal are
+ * skipped.
+ *
+ * The first line of the journal records a key of the model which
+ * produced the results, and a journal with another key is discarded
+ * along with its output file, so that a scan is never resumed with a
+ * different model. An output file without a journal is not replaced
+ * unless overwriting is requested.
+ */
+#include <iostream>
+#include <mlearn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scanjournal.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a scan journal for an output file. If a journal
+ * with the same model key exists for the output file, the scan
+ * is resumed from it.
+ *
+ * @param path_output
+ * @param key
+ * @param overwrite
+ */
+ScanJournal::ScanJournal(const std::string& path_output, const std::string& key, bool overwrite)
+{
+	_path_output = path_output;
+	_path_journal = path_output + ".journal";
+
+	_num_resumed = 0;
+	_num_written = 0;
+	_num_rows = 0;
+
+	// refuse to replace an output file which has no journal
+	struct stat st;
+	bool has_output = (stat(_path_output.c_str(), &st) == 0);
+	bool has_journal = (stat(_path_journal.c_str(), &st) == 0);
+
+	if ( has_output && !has_journal && !overwrite ) {
+		std::cerr << "error: " << _path_output << " exists but has no journal, use --scan_overwrite to replace it\n";
+		exit(1);
+	}
+
+	// read the model key of the journal
+	std::ifstream journal(_path_journal);
+	std::string header = "key\t" + key;
+	std::string line;
+	bool valid = false;
+	long journal_size = 0;
+
+	_output_size = 0;
+
+	if ( journal.is_open() ) {
+		std::getline(journal, line);
+
+		if ( !journal.eof() && line == header ) {
+			valid = true;
+			journal_size = journal.tellg();
+		}
+		else if ( !journal.eof() ) {
+			std::cerr << "warning: " << _path_journal << " was written with another model, discarding " << _path_output << "\n";
+		}
+	}
+
+	// read completed files from the journal
+	while ( valid && journal.good() ) {
+		std::getline(journal, line);
+
+		// ignore a partial entry at the end of the journal
+		if ( journal.eof() ) {
+			break;
+		}
+
+		size_t tab = line.find('\t');
+
+		if ( tab == std::string::npos ) {
+			break;
+		}
+
+		_output_size = std::stol(line.substr(0, tab));
+		journal_size = journal.tellg();
+
+		_completed.insert(line.substr(tab + 1));
+	}
+
+	journal.close();
+
+	_num_resumed = _completed.size();
+
+	// discard output and journal entries after the last complete entry
+	if ( stat(_path_output.c_str(), &st) == 0 && truncate(_path_output.c_str(), _output_size) != 0 ) {
+		std::cerr << "error: could not truncate " << _path_output << "\n";
+		exit(1);
+	}
+
+	if ( stat(_path_journal.c_str(), &st) == 0 && truncate(_path_journal.c_str(), journal_size) != 0 ) {
+		std::cerr << "error: could not truncate " << _path_journal << "\n";
+		exit(1);
+	}
+
+	// open output file and journal for appending
+	_output.open(_path_output, std::ofstream::app);
+	_journal.open(_path_journal, std::ofstream::app);
+
+	if ( !_output.is_open() || !_journal.is_open() ) {
+		std::cerr << "error: could not open " << _path_output << "\n";
+		exit(1);
+	}
+
+	if ( journal_size == 0 ) {
+		_journal << header << "\n";
+		_journal.flush();
+	}
+
+	if ( _output_size == 0 ) {
+		std::string columns = "file,x,y,width,height,label,distance\n";
+
+		_output << columns;
+		_output.flush();
+		_output_size = columns.size();
+	}
+
+	if ( _num_resumed > 0 ) {
+		log(LogLevel::Info, "scan: resuming %s, %d files already scanned", _path_output.c_str(), _num_resumed);
+	}
+}
+
+
+
+/**
+ * Determine whether a file was scanned by a previous run.
+ *
+ * @param filename
+ */
+bool ScanJournal::completed(const std::string& filename) const
+{
+	return _completed.find(filename) != _completed.end();
+}
+
+
+
+/**
+ * Append the results of a file to the output file and then
+ * record the file in the journal.
+ *
+ * @param filename
+ * @param rows
+ * @param num_rows
+ */
+void ScanJournal::write(const std::string& filename, const std::string& rows, int num_rows)
+{
+	_output << rows;
+	_output.flush();
+	_output_size += rows.size();
+
+	_journal << _output_size << "\t" << filename << "\n";
+	_journal.flush();
+
+	if ( !_output.good() || !_journal.good() ) {
+		std::cerr << "error: could not write " << _path_output << "\n";
+		exit(1);
+	}
+
+	_num_written++;
+	_num_rows += num_rows;
+}
+
+
+
+/**
+ * Print journal statistics.
+ */
+void ScanJournal::print_stats()
+{
+	log(LogLevel::Info, "scan: %d files resumed, %d files written, %ld faces written to %s",
+		_num_resumed,
+		_num_written,
+		_num_rows,
+		_path_output.c_str());
+}
@@ -0,0 +1,41 @@
+/**
+ * @file scanjournal.h
+ *
+ * Interface definitions for the scan journal.
+ */
+#ifndef SCANJOURNAL_H
+#define SCANJOURNAL_H
+
+#include <fstream>
+#include <set>
+#include <string>
+
+
+
+class ScanJournal {
+private:
+	std::string _path_output;
+	std::string _path_journal;
+	std::ofstream _output;
+	std::ofstream _journal;
+	std::set<std::string> _completed;
+	long _output_size;
+
+	int _num_resumed;
+	int _num_written;
+	long _num_rows;
+
+public:
+	ScanJournal(const std::string& path_output, const std::string& key, bool overwrite);
+
+	const std::string& path_output() const { return _path_output; }
+
+	bool completed(const std::string& filename) const;
+	void write(const std::string& filename, const std::string& rows, int num_rows);
+
+	void print_stats();
+};
+
+
+
+#endif
@@ -0,0 +1,621 @@
+/**
+ * @file streamldalayer.cpp
+ *
+ * Implementation of the streaming LDA feature layer.
+ *
+ * The layer computes Fisherfaces in two stages, like the LDA layer:
+ * samples are first projected into a PCA subspace, and LDA is then
+ * performed in that subspace. Instead of forming the scatter matrices
+ * from the whole projected training set, the layer accumulates the
+ * class counts, class sums and second moment of the projected samples
+ * one batch at a time. The scatter matrices are derived from these
+ * statistics, so the working memory depends only on the number of
+ * principal components and classes, and new batches (including new
+ * classes) can be added at any time before solving again. Batches of
+ * sparse samples are projected without expanding them.
+ */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "linalg.h"
+#include "streamldalayer.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct a scatter accumulator.
+ *
+ * @param dims
+ */
+ScatterAccumulator::ScatterAccumulator(int dims)
+{
+	_dims = dims;
+	_num_samples = 0;
+	_moment.assign((size_t) dims * dims, 0.0);
+}
+
+
+
+/**
+ * Get the memory used by the accumulator in bytes.
+ */
+size_t ScatterAccumulator::memory() const
+{
+	return (_shift.size() + _moment.size() + _sums.size()) * sizeof(double)
+		+ _counts.size() * sizeof(long);
+}
+
+
+
+/**
+ * Add a batch of samples to the accumulator. Classes which
+ * have not been seen before are added automatically.
+ *
+ * All statistics are accumulated relative to the mean of the
+ * first batch, which avoids cancellation when the scatter
+ * matrices are derived from the raw second moment.
+ *
+ * @param X
+ * @param y
+ */
+void ScatterAccumulator::add(const Matrix& X, const std::vector<int>& y)
+{
+	assert(X.rows() == _dims);
+
+	int n = X.cols();
+
+	// initialize shift to the mean of the first batch
+	if ( _shift.empty() ) {
+		_shift.assign(_dims, 0.0);
+
+		for ( int i = 0; i < n; i++ ) {
+			for ( int j = 0; j < _dims; j++ ) {
+				_shift[j] += X.elem(j, i) / n;
+			}
+		}
+	}
+
+	// extend class statistics for new classes
+	for ( int i = 0; i < n; i++ ) {
+		if ( y[i] >= num_classes() ) {
+			_counts.resize(y[i] + 1, 0);
+			_sums.resize((size_t) (y[i] + 1) * _dims, 0.0);
+		}
+	}
+
+	// accumulate class sums
+	std::vector<float> X_s((size_t) n * _dims);
+
+	for ( int i = 0; i < n; i++ ) {
+		float *x = &X_s[(size_t) i * _dims];
+		double *s = &_sums[(size_t) y[i] * _dims];
+
+		for ( int j = 0; j < _dims; j++ ) {
+			x[j] = X.elem(j, i) - _shift[j];
+			s[j] += x[j];
+		}
+
+		_counts[y[i]]++;
+	}
+
+	// accumulate upper triangle of second moment
+	sym_rank_k(X_s.data(), n, _dims, _moment);
+
+	_num_samples += n;
+}
+
+
+
+/**
+ * Compute the within-class and between-class scatter matrices:
+ *
+ *   S_b = sum_k n_k * m_k * m_k' - n * m * m'
+ *   S_w = M - sum_k n_k * m_k * m_k'
+ *
+ * where M is the second moment, m_k are the class means and m
+ * is the total mean.
+ *
+ * @param S_w
+ * @param S_b
+ */
+void ScatterAccumulator::scatter(std::vector<double>& S_w, std::vector<double>& S_b) const
+{
+	const int d = _dims;
+
+	S_w.assign((size_t) d * d, 0.0);
+	S_b.assign((size_t) d * d, 0.0);
+
+	std::vector<double> mean(d, 0.0);
+
+	for ( int k = 0; k < num_classes(); k++ ) {
+		if ( _counts[k] == 0 ) {
+			continue;
+		}
+
+		const double *s = &_sums[(size_t) k * d];
+
+		for ( int r = 0; r < d; r++ ) {
+			mean[r] += s[r];
+
+			for ( int j = 0; j <= r; j++ ) {
+				S_b[(size_t) r * d + j] += s[r] * s[j] / _counts[k];
+			}
+		}
+	}
+
+	for ( int r = 0; r < d; r++ ) {
+		for ( int j = 0; j <= r; j++ ) {
+			double B = S_b[(size_t) r * d + j];
+			double W = _moment[(size_t) j * d + r] - B;
+
+			B -= mean[r] * mean[j] / _num_samples;
+
+			S_b[(size_t) r * d + j] = S_b[(size_t) j * d + r] = B;
+			S_w[(size_t) r * d + j] = S_w[(size_t) j * d + r] = W;
+		}
+	}
+}
+
+
+
+/**
+ * Save a scatter accumulator to a file.
+ *
+ * @param file
+ */
+void ScatterAccumulator::save(std::ofstream& file)
+{
+	int num_classes = this->num_classes();
+	int has_shift = !_shift.empty();
+
+	file.write(reinterpret_cast<const char *>(&_num_samples), sizeof(long));
+	file.write(reinterpret_cast<const char *>(&num_classes), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&has_shift), sizeof(int));
+	file.write(reinterpret_cast<const char *>(_shift.data()), _shift.size() * sizeof(double));
+	file.write(reinterpret_cast<const char *>(_moment.data()), _moment.size() * sizeof(double));
+	file.write(reinterpret_cast<const char *>(_counts.data()), _counts.size() * sizeof(long));
+	file.write(reinterpret_cast<const char *>(_sums.data()), _sums.size() * sizeof(double));
+}
+
+
+
+/**
+ * Load a scatter accumulator from a file.
+ *
+ * @param file
+ */
+void ScatterAccumulator::load(std::ifstream& file)
+{
+	int num_classes;
+	int has_shift;
+
+	file.read(reinterpret_cast<char *>(&_num_samples), sizeof(long));
+	file.read(reinterpret_cast<char *>(&num_classes), sizeof(int));
+	file.read(reinterpret_cast<char *>(&has_shift), sizeof(int));
+
+	_shift.resize(has_shift ? _dims : 0);
+	_counts.resize(num_classes);
+	_sums.resize((size_t) num_classes * _dims);
+
+	file.read(reinterpret_cast<char *>(_shift.data()), _shift.size() * sizeof(double));
+	file.read(reinterpret_cast<char *>(_moment.data()), _moment.size() * sizeof(double));
+	file.read(reinterpret_cast<char *>(_counts.data()), _counts.size() * sizeof(long));
+	file.read(reinterpret_cast<char *>(_sums.data()), _sums.size() * sizeof(double));
+}
+
+
+
+/**
+ * Construct a streaming LDA layer.
+ *
+ * @param n1
+ * @param n2
+ * @param batch
+ * @param solver
+ * @param energy
+ */
+StreamLDALayer::StreamLDALayer(int n1, int n2, int batch, EigenSolver solver, float energy)
+{
+	_n1 = n1;
+	_n2 = n2;
+	_batch = batch;
+	_solver = solver;
+	_energy = energy;
+
+	_num_batches = 0;
+	_batch_time = 0;
+}
+
+
+
+/**
+ * Compute the Fisherfaces of a training set. The PCA stage is
+ * computed from the whole training set, and the scatter matrices
+ * are accumulated from the projected samples in batches. A batch
+ * size of zero accumulates the whole training set at once.
+ *
+ * @param X
+ * @param y
+ * @param c
+ */
+void StreamLDALayer::compute(const Matrix& X, const std::vector<int>& y, int c)
+{
+	int n = X.cols();
+
+	if ( _n1 <= 0 ) {
+		_n1 = n - c;
+	}
+
+	_pca.reset(create_pca(_solver, _n1, _energy));
+	_pca->compute(X, y, c);
+	_scatter.reset();
+
+	int batch = (_batch > 0) ? _batch : n;
+
+	for ( int i = 0; i < n; i += batch ) {
+		int n_b = std::min(batch, n - i);
+		Matrix X_b(X.rows(), n_b);
+		std::vector<int> y_b(y.begin() + i, y.begin() + i + n_b);
+
+		for ( int q = 0; q < n_b; q++ ) {
+			for ( int j = 0; j < X.rows(); j++ ) {
+				X_b.elem(j, q) = X.elem(j, i + q);
+			}
+		}
+
+		partial_fit(X_b, y_b);
+	}
+
+	solve();
+}
+
+
+
+/**
+ * Limit the number of principal components to what a batch can
+ * support, and get the number of classes of the batch.
+ *
+ * @param n
+ * @param y
+ */
+int StreamLDALayer::limit_n1(int n, const std::vector<int>& y)
+{
+	std::vector<int> classes(y);
+
+	std::sort(classes.begin(), classes.end());
+	classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+
+	int n1_max = n - classes.size();
+
+	if ( _n1 <= 0 || _n1 > n1_max ) {
+		_n1 = n1_max;
+	}
+
+	return classes.back() + 1;
+}
+
+
+
+/**
+ * Add a batch of projected samples to the scatter matrices.
+ *
+ * @param P
+ * @param y
+ */
+void StreamLDALayer::accumulate(const Matrix& P, const std::vector<int>& y)
+{
+	// the PCA stage may select fewer components than n1
+	if ( !_scatter ) {
+		_n1 = P.rows();
+		_scatter.reset(new ScatterAccumulator(_n1));
+	}
+
+	_scatter->add(P, y);
+}
+
+
+
+/**
+ * Add a batch of samples to the scatter matrices. If the PCA
+ * stage has not been computed, it is computed from this batch.
+ * New classes may be added in any batch, which allows new
+ * identities to be enrolled without revisiting old batches.
+ *
+ * @param X
+ * @param y
+ */
+void StreamLDALayer::partial_fit(const Matrix& X, const std::vector<int>& y)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if ( !_pca ) {
+		int c = limit_n1(X.cols(), y);
+
+		_pca.reset(create_pca(_solver, _n1, _energy));
+		_pca->compute(X, y, c);
+	}
+
+	accumulate(_pca->project(X), y);
+
+	auto end = std::chrono::steady_clock::now();
+
+	_num_batches++;
+	_batch_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Add a batch of sparse samples, whose rows are shifted by an
+ * offset, to the scatter matrices without expanding the samples.
+ * Since only the Lanczos PCA layer can fit and project sparse
+ * samples, the PCA stage always uses the Lanczos solver.
+ *
+ * @param X
+ * @param offset
+ * @param y
+ */
+void StreamLDALayer::partial_fit(const csr_matrix_t& X, const std::vector<float>& offset, const std::vector<int>& y)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if ( !_pca ) {
+		limit_n1(X.rows, y);
+
+		LanczosPCALayer *pca = new LanczosPCALayer(_n1, _energy);
+
+		pca->compute(X, offset);
+		_pca.reset(pca);
+	}
+
+	LanczosPCALayer *pca = dynamic_cast<LanczosPCALayer *>(_pca.get());
+
+	if ( pca == nullptr ) {
+		std::cerr << "error: sparse batches require a Lanczos PCA stage\n";
+		exit(1);
+	}
+
+	accumulate(pca->project(X, offset), y);
+
+	auto end = std::chrono::steady_clock::now();
+
+	_num_batches++;
+	_batch_time += std::chrono::duration<float>(end - start).count();
+}
+
+
+
+/**
+ * Solve the generalized eigenvalue problem S_b * w = lambda * S_w * w
+ * for the current scatter matrices. The problem is reduced to a
+ * symmetric eigenvalue problem with the Cholesky factor S_w = L * L':
+ *
+ *   (L^-1 * S_b * L^-T) * v = lambda * v,  w = L^-T * v
+ */
+void StreamLDALayer::solve()
+{
+	std::vector<double> S_w;
+	std::vector<double> S_b;
+
+	_scatter->scatter(S_w, S_b);
+
+	int n1 = _n1;
+	int n2 = (_n2 > 0) ? _n2 : _scatter->num_classes() - 1;
+
+	n2 = std::min(n2, n1);
+
+	// factor the within-class scatter, regularizing it if it is singular
+	double trace = 0;
+
+	for ( int j = 0; j < n1; j++ ) {
+		trace += S_w[(size_t) j * n1 + j];
+	}
+
+	std::vector<double> L = S_w;
+	double reg = 1e-9 * trace / n1;
+
+	while ( !cholesky(L, n1) ) {
+		L = S_w;
+		reg *= 10;
+
+		for ( int j = 0; j < n1; j++ ) {
+			L[(size_t) j * n1 + j] += reg;
+		}
+	}
+
+	tri_inverse(L, n1);
+
+	// compute C = L^-1 * S_b * L^-T
+	std::vector<double> T((size_t) n1 * n1, 0.0);
+	std::vector<double> C((size_t) n1 * n1, 0.0);
+
+	for ( int i = 0; i < n1; i++ ) {
+		for ( int k = 0; k <= i; k++ ) {
+			double l_ik = L[(size_t) i * n1 + k];
+
+			for ( int j = 0; j < n1; j++ ) {
+				T[(size_t) i * n1 + j] += l_ik * S_b[(size_t) k * n1 + j];
+			}
+		}
+	}
+
+	for ( int i = 0; i < n1; i++ ) {
+		for ( int j = 0; j <= i; j++ ) {
+			double sum = 0;
+
+			for ( int k = 0; k <= j; k++ ) {
+				sum += T[(size_t) i * n1 + k] * L[(size_t) j * n1 + k];
+			}
+
+			C[(size_t) i * n1 + j] = C[(size_t) j * n1 + i] = sum;
+		}
+	}
+
+	// compute the top eigenvectors and map them back
+	std::vector<double> evals;
+
+	sym_eigen(C, n1, evals);
+
+	_W.assign((size_t) n2 * n1, 0.0f);
+
+	for ( int i = 0; i < n2; i++ ) {
+		for ( int j = 0; j < n1; j++ ) {
+			double sum = 0;
+
+			for ( int k = j; k < n1; k++ ) {
+				sum += L[(size_t) k * n1 + j] * C[(size_t) k * n1 + i];
+			}
+
+			_W[(size_t) i * n1 + j] = sum;
+		}
+	}
+}
+
+
+
+/**
+ * Project a matrix onto the Fisherfaces.
+ *
+ * @param X
+ */
+Matrix StreamLDALayer::project(const Matrix& X)
+{
+	Matrix P = _pca->project(X);
+	int n1 = _n1;
+	int n2 = _W.size() / n1;
+	Matrix Z(n2, X.cols());
+
+	for ( int q = 0; q < X.cols(); q++ ) {
+		for ( int i = 0; i < n2; i++ ) {
+			const float *W_i = &_W[(size_t) i * n1];
+			float sum = 0;
+
+			for ( int j = 0; j < n1; j++ ) {
+				sum += W_i[j] * P.elem(j, q);
+			}
+
+			Z.elem(i, q) = sum;
+		}
+	}
+
+	return Z;
+}
+
+
+
+/**
+ * Save a streaming LDA layer to a file. The scatter statistics
+ * are saved along with the Fisherfaces so that a loaded layer
+ * can continue to accept new batches. The solver and energy of
+ * the PCA stage are saved as well, since a layer fitted on sparse
+ * batches uses the Lanczos solver regardless of its own solver.
+ *
+ * @param file
+ */
+void StreamLDALayer::save(std::ofstream& file)
+{
+	int n2 = _W.size() / _n1;
+	int solver = (int) (dynamic_cast<LanczosPCALayer *>(_pca.get()) != nullptr
+		? EigenSolver::Lanczos
+		: EigenSolver::Full);
+
+	file.write(reinterpret_cast<const char *>(&_n1), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_n2), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&n2), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&solver), sizeof(int));
+	file.write(reinterpret_cast<const char *>(&_energy), sizeof(float));
+
+	_pca->save(file);
+	_scatter->save(file);
+
+	file.write(reinterpret_cast<const char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Load a streaming LDA layer from a file.
+ *
+ * @param file
+ */
+void StreamLDALayer::load(std::ifstream& file)
+{
+	int n2;
+	int solver;
+
+	file.read(reinterpret_cast<char *>(&_n1), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_n2), sizeof(int));
+	file.read(reinterpret_cast<char *>(&n2), sizeof(int));
+	file.read(reinterpret_cast<char *>(&solver), sizeof(int));
+	file.read(reinterpret_cast<char *>(&_energy), sizeof(float));
+
+	// rebuild the PCA stage with the solver it was fitted with
+	_solver = (EigenSolver) solver;
+	_pca.reset(create_pca(_solver, _n1, _energy));
+	_pca->load(file);
+	_scatter.reset(new ScatterAccumulator(_n1));
+	_scatter->load(file);
+
+	_W.resize((size_t) n2 * _n1);
+	file.read(reinterpret_cast<char *>(_W.data()), _W.size() * sizeof(float));
+}
+
+
+
+/**
+ * Truncate a streaming LDA layer to its first n Fisherfaces.
+ *
+ * @param n
+ */
+void StreamLDALayer::truncate(int n)
+{
+	int n2 = std::min(n, (int) (_W.size() / _n1));
+
+	_n2 = n2;
+	_W.resize((size_t) n2 * _n1);
+}
+
+
+
+/**
+ * Print information about a streaming LDA layer.
+ */
+void StreamLDALayer::print()
+{
+	log(LogLevel::Verbose, "LDA (streaming)");
+	log(LogLevel::Verbose, "  %-20s  %10d", "n1", _n1);
+	log(LogLevel::Verbose, "  %-20s  %10d", "n2", _n2);
+	log(LogLevel::Verbose, "  %-20s  %10d", "batch", _batch);
+	log(LogLevel::Verbose, "  %-20s  %10f", "energy", _energy);
+	log(LogLevel::Verbose, "");
+}
+
+
+
+/**
+ * Print accumulation statistics.
+ */
+void StreamLDALayer::print_stats()
+{
+	if ( !_scatter || _num_batches == 0 ) {
+		return;
+	}
+
+	long n = _scatter->num_samples();
+
+	log(LogLevel::Info, "lda: %ld samples, %d classes, %d batches", n, _scatter->num_classes(), _num_batches);
+	log(LogLevel::Info, "lda: %.3f ms per batch", 1000 * _batch_time / _num_batches);
+	log(LogLevel::Info, "lda: accumulator %.2f MB", _scatter->memory() / 1e6);
+
+	LanczosPCALayer *pca = dynamic_cast<LanczosPCALayer *>(_pca.get());
+
+	if ( pca != nullptr ) {
+		pca->print_stats();
+	}
+}
@@ -0,0 +1,81 @@
+/**
+ * @file streamldalayer.h
+ *
+ * Interface definitions for the streaming LDA feature layer.
+ */
+#ifndef STREAMLDALAYER_H
+#define STREAMLDALAYER_H
+
+#include <fstream>
+#include <memory>
+#include <mlearn.h>
+#include <vector>
+#include "csrmatrix.h"
+#include "lanczospcalayer.h"
+
+
+
+class ScatterAccumulator {
+private:
+	int _dims;
+	long _num_samples;
+	std::vector<double> _shift;
+	std::vector<double> _moment;
+	std::vector<long> _counts;
+	std::vector<double> _sums;
+
+public:
+	ScatterAccumulator(int dims);
+
+	int num_classes() const { return _counts.size(); }
+	long num_samples() const { return _num_samples; }
+	size_t memory() const;
+
+	void add(const ML::Matrix& X, const std::vector<int>& y);
+	void scatter(std::vector<double>& S_w, std::vector<double>& S_b) const;
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+};
+
+
+
+class StreamLDALayer : public ML::FeatureLayer {
+private:
+	int _n1;
+	int _n2;
+	int _batch;
+	EigenSolver _solver;
+	float _energy;
+
+	std::unique_ptr<ML::FeatureLayer> _pca;
+	std::unique_ptr<ScatterAccumulator> _scatter;
+	std::vector<float> _W;
+
+	int _num_batches;
+	float _batch_time;
+
+	int limit_n1(int n, const std::vector<int>& y);
+	void accumulate(const ML::Matrix& P, const std::vector<int>& y);
+
+public:
+	StreamLDALayer(int n1, int n2, int batch, EigenSolver solver, float energy);
+	~StreamLDALayer() {};
+
+	void compute(const ML::Matrix& X, const std::vector<int>& y, int c);
+	void partial_fit(const ML::Matrix& X, const std::vector<int>& y);
+	void partial_fit(const csr_matrix_t& X, const std::vector<float>& offset, const std::vector<int>& y);
+	void solve();
+	ML::Matrix project(const ML::Matrix& X);
+
+	void save(std::ofstream& file);
+	void load(std::ifstream& file);
+	void truncate(int n);
+
+	void print();
+	void print_stats();
+};
+
+
+
+#endif
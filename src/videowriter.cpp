@@ -0,0 +1,166 @@
+/**
+ * @file videowriter.cpp
+ *
+ * Implementation of the asynchronous video writer.
+ *
+ * The writer moves the output stage of a video stream off of the
+ * processing thread. The processing thread only hands each frame,
+ * along with its faces and labels, to a bounded queue; a dedicated
+ * thread draws the annotations and encodes the frame. When the
+ * encoder falls behind, the processing thread either waits for room
+ * in the queue, so that every frame is written, or drops the frame,
+ * so that processing is never delayed by the output.
+ */
+#include <chrono>
+#include <iostream>
+#include <mlearn.h>
+#include "videowriter.h"
+
+
+
+using namespace ML;
+
+
+
+/**
+ * Construct an asynchronous video writer. The output file is
+ * opened when the first frame arrives, since the frame size is
+ * not known until then.
+ *
+ * @param path
+ * @param fps
+ * @param annotate
+ * @param policy
+ * @param capacity
+ */
+AsyncVideoWriter::AsyncVideoWriter(const std::string& path, double fps, annotate_func_t annotate, WritePolicy policy, int capacity)
+	: _queue(capacity)
+{
+	_path = path;
+	_fps = fps;
+	_annotate = annotate;
+	_policy = policy;
+	_closed = false;
+
+	_num_submitted = 0;
+	_num_written = 0;
+	_num_dropped = 0;
+	_submit_time = 0;
+	_write_time = 0;
+
+	_thread = std::thread(&AsyncVideoWriter::run, this);
+}
+
+
+
+/**
+ * Destruct an asynchronous video writer.
+ */
+AsyncVideoWriter::~AsyncVideoWriter()
+{
+	close();
+}
+
+
+
+/**
+ * Annotate and encode frames until the queue is closed.
+ */
+void AsyncVideoWriter::run()
+{
+	cv::VideoWriter writer;
+	output_frame_t item;
+
+	while ( _queue.pop(item) ) {
+		auto start = std::chrono::steady_clock::now();
+
+		if ( !writer.isOpened() ) {
+			writer = cv::VideoWriter(_path, CV_FOURCC('M', 'J', 'P', 'G'), _fps, item.frame.size());
+
+			if ( !writer.isOpened() ) {
+				std::cerr << "error: could not open " << _path << "\n";
+				exit(1);
+			}
+		}
+
+		if ( _annotate ) {
+			_annotate(item.frame, item.rects, item.labels);
+		}
+
+		writer.write(item.frame);
+
+		_write_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		_num_written++;
+	}
+
+	writer.release();
+}
+
+
+
+/**
+ * Submit a frame to be written. The frame is moved into the
+ * queue, so the caller should not modify it afterwards.
+ *
+ * @param frame
+ * @param rects
+ * @param labels
+ */
+void AsyncVideoWriter::write(cv::Mat& frame, const std::vector<cv::Rect>& rects, const std::vector<std::string>& labels)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	output_frame_t item = { frame, rects, labels };
+
+	if ( _policy == WritePolicy::Drop ) {
+		if ( !_queue.try_push(std::move(item)) ) {
+			_num_dropped++;
+		}
+	}
+	else {
+		_queue.push(std::move(item));
+	}
+
+	_submit_time += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	_num_submitted++;
+}
+
+
+
+/**
+ * Write the remaining frames and close the output file.
+ */
+void AsyncVideoWriter::close()
+{
+	if ( _closed ) {
+		return;
+	}
+
+	_queue.close();
+	_thread.join();
+	_closed = true;
+}
+
+
+
+/**
+ * Print writer statistics. The write time is spent on the writer
+ * thread, so it is the time saved on the processing thread compared
+ * to drawing and encoding each frame in place; the submit time is
+ * what the processing thread still spends on the output.
+ */
+void AsyncVideoWriter::print_stats()
+{
+	if ( _num_submitted == 0 ) {
+		return;
+	}
+
+	log(LogLevel::Info, "output: %d frames, %d written, %d dropped to %s",
+		_num_submitted,
+		_num_written,
+		_num_dropped,
+		_path.c_str());
+	log(LogLevel::Info, "output: %.3f ms per frame on the writer thread, %.3f ms per frame on the processing thread",
+		(_num_written > 0) ? 1000 * _write_time / _num_written : 0.0f,
+		1000 * _submit_time / _num_submitted);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file videowriter.h
+ *
+ * Interface definitions for the asynchronous video writer.
+ */
+#ifndef VIDEOWRITER_H
+#define VIDEOWRITER_H
+
+#include <functional>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+#include "workqueue.h"
+
+
+
+enum class WritePolicy {
+	None,
+	Block,
+	Drop
+};
+
+
+
+typedef std::function<void(cv::Mat&, const std::vector<cv::Rect>&, const std::vector<std::string>&)> annotate_func_t;
+
+
+
+typedef struct {
+	cv::Mat frame;
+	std::vector<cv::Rect> rects;
+	std::vector<std::string> labels;
+} output_frame_t;
+
+
+
+class AsyncVideoWriter {
+private:
+	std::string _path;
+	double _fps;
+	annotate_func_t _annotate;
+	WritePolicy _policy;
+	WorkQueue<output_frame_t> _queue;
+	std::thread _thread;
+	bool _closed;
+
+	int _num_submitted;
+	int _num_written;
+	int _num_dropped;
+	float _submit_time;
+	float _write_time;
+
+	void run();
+
+public:
+	AsyncVideoWriter(const std::string& path, double fps, annotate_func_t annotate, WritePolicy policy, int capacity=8);
+	~AsyncVideoWriter();
+
+	void write(cv::Mat& frame, const std::vector<cv::Rect>& rects, const std::vector<std::string>& labels);
+	void close();
+
+	void print_stats();
+};
+
+
+
+#endif
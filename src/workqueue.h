@@ -0,0 +1,109 @@
+/**
+ * @file workqueue.h
+ *
+ * Interface definitions for the bounded work queue.
+ *
+ * The queue connects the stages of a pipeline. A producer blocks
+ * when the queue is full, so that a fast stage cannot run ahead of
+ * a slow one and fill memory with decoded images, and a consumer
+ * blocks until an item is available or the queue has been closed.
+ */
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+
+template <class T>
+class WorkQueue {
+private:
+	std::deque<T> _items;
+	size_t _capacity;
+	std::mutex _mutex;
+	std::condition_variable _not_empty;
+	std::condition_variable _not_full;
+	bool _closed;
+
+public:
+	WorkQueue(size_t capacity)
+	{
+		_capacity = capacity;
+		_closed = false;
+	}
+
+	/**
+	 * Add an item to the queue, waiting while the queue is full.
+	 *
+	 * @param item
+	 */
+	void push(T item)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_not_full.wait(lock, [this] { return _items.size() < _capacity; });
+		_items.push_back(std::move(item));
+		_not_empty.notify_one();
+	}
+
+	/**
+	 * Add an item to the queue if it is not full. Returns false
+	 * if the item was not added.
+	 *
+	 * @param item
+	 */
+	bool try_push(T item)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if ( _items.size() >= _capacity ) {
+			return false;
+		}
+
+		_items.push_back(std::move(item));
+		_not_empty.notify_one();
+
+		return true;
+	}
+
+	/**
+	 * Remove an item from the queue, waiting while the queue is
+	 * empty. Returns false once the queue is closed and empty.
+	 *
+	 * @param item
+	 */
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_not_empty.wait(lock, [this] { return !_items.empty() || _closed; });
+
+		if ( _items.empty() ) {
+			return false;
+		}
+
+		item = std::move(_items.front());
+		_items.pop_front();
+		_not_full.notify_one();
+
+		return true;
+	}
+
+	/**
+	 * Close the queue. Consumers drain the remaining items
+	 * and then stop.
+	 */
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_closed = true;
+		_not_empty.notify_all();
+	}
+};
+
+
+
+#endif